@@ -0,0 +1,109 @@
+/*  Title		: bench
+ *  Filename		: bench.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: cycle benchmark helpers for simulavr
+ *
+ *	Timer1 runs free at clk/1 and is used as cycle counter, benchmarks
+ *	must therefore not use the led pwm. Results are written as csv lines
+ *	"name,param,min,max,avg" to the simulavr output port.
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <bench.h>
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+//cost of two back to back bench_cycles(), removed from every sample
+static uint16_t bench_overhead;
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void bench_init(void) {
+	TIMSK1 = 0;
+	TCCR1A = 0; //normal mode
+	TCCR1B = 0b001<<CSO; //clk/1
+	TCNT1 = 0;
+
+	uint16_t start = bench_cycles();
+	uint16_t stop = bench_cycles();
+	bench_overhead = stop - start;
+}
+
+//busy loop, simulates cpu bound work
+void bench_spin(uint16_t cycles) {
+	uint16_t start = bench_cycles();
+	while((uint16_t)(bench_cycles() - start) < cycles);
+}
+
+void bench_send(const char * data, uint16_t len) {
+	while(len--) {
+		_MMIO_BYTE(BENCH_OUTPUT_PORT) = *data++;
+	}
+}
+
+void bench_send_u32(uint32_t value) {
+	char buffer[10];
+	uint8_t i = 0;
+	do {
+		buffer[i++] = '0' + (value % 10);
+		value /= 10;
+	} while(value);
+	while(i) {
+		_MMIO_BYTE(BENCH_OUTPUT_PORT) = buffer[--i];
+	}
+}
+
+void bench_stat_init(bench_stat_t * stat) {
+	stat->min = 0xFFFF;
+	stat->max = 0;
+	stat->sum = 0;
+	stat->count = 0;
+}
+
+void bench_stat_add(bench_stat_t * stat, uint16_t cycles) {
+	cycles -= bench_overhead;
+	if(cycles < stat->min) {
+		stat->min = cycles;
+	}
+	if(cycles > stat->max) {
+		stat->max = cycles;
+	}
+	stat->sum += cycles;
+	stat->count++;
+}
+
+void bench_report(const char * name, uint16_t param, bench_stat_t * stat) {
+	uint8_t len = 0;
+	while(name[len] && len < BENCH_NAME_LEN) {
+		len++;
+	}
+	bench_send(name, len);
+	bench_print(",");
+	bench_send_u32(param);
+	bench_print(",");
+	//no sample: 0 rather than the initial minimum
+	bench_send_u32(stat->count ? stat->min : 0);
+	bench_print(",");
+	bench_send_u32(stat->max);
+	bench_print(",");
+	bench_send_u32(stat->count ? stat->sum / stat->count : 0);
+	bench_print("\n");
+}
+
+void bench_exit(uint8_t code) {
+	_MMIO_BYTE(BENCH_EXIT_PORT) = code;
+	for(;;);
+}
+
+/* END */
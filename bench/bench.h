@@ -0,0 +1,80 @@
+/*  Title       : bench
+ *  Filename    : bench.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : cycle benchmark helpers for simulavr
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <stdint.h>
+
+#include <atmega328p.h>
+#include <avr/io.h>
+
+/**********************
+ *  CONSTANTS
+ **********************/
+
+/* simulavr special registers (-W 0x20,- -e 0x21) */
+#define BENCH_OUTPUT_PORT	0x20
+#define BENCH_EXIT_PORT		0x21
+
+#define BENCH_NAME_LEN		16
+
+
+/**********************
+ *  MACROS
+ **********************/
+
+#define bench_cycles() \
+    (TCNT1)
+
+#define bench_print(string) \
+    bench_send(string, sizeof(string)-1)
+
+
+/**********************
+ *  TYPEDEFS
+ **********************/
+
+typedef struct bench_stat {
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+	uint16_t count;
+}bench_stat_t;
+
+
+/**********************
+ *  PROTOTYPES
+ **********************/
+
+void bench_init(void);
+
+void bench_spin(uint16_t cycles);
+
+void bench_send(const char * data, uint16_t len);
+
+void bench_send_u32(uint32_t value);
+
+void bench_stat_init(bench_stat_t * stat);
+
+void bench_stat_add(bench_stat_t * stat, uint16_t cycles);
+
+void bench_report(const char * name, uint16_t param, bench_stat_t * stat);
+
+void bench_exit(uint8_t code);
+
+
+#endif /* BENCH_H */
+
+/* END */
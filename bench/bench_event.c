@@ -0,0 +1,130 @@
+/*  Title		: bench_event
+ *  Filename		: bench_event.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: event signal cycle benchmark
+ *
+ *	BENCH_THREADS threads run, idle and timer service (OS_TIMERS)
+ *	included: a high priority signaller, a single lower priority waiter
+ *	and suspended fillers. event_signal measures os_event_signal()
+ *	waking the waiter without switching to it, so the result should
+ *	only depend on the number of waiters and not on the number of
+ *	threads.
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <hal.h>
+#include <bench.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#ifndef BENCH_THREADS
+#define BENCH_THREADS	3
+#endif
+
+#define BENCH_RUNS	16
+
+#define BENCH_FILLERS	(BENCH_THREADS - 3 - OS_TIMERS)
+
+#if BENCH_FILLERS < 0
+#error "BENCH_THREADS is lower than the threads the benchmark needs"
+#endif
+
+#define SIGNALLER_PRIO	(OS_PRIORITY_LEVELS - 1)
+#define WAITER_PRIO	1
+
+#define THREAD_STACK_SIZE	96
+//fillers are suspended before they run, their stack only holds the
+//first frame, so that 16 threads fit in the 2kB of ram
+#define FILLER_STACK_SIZE	(PORT_FRAME_LIGHT_REGS + 2)
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static os_event_t event;
+
+static bench_stat_t signal_stat;
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void waiter_entry(void) {
+	for(;;) {
+		os_event_wait(&event);
+	}
+}
+
+//suspended before it runs
+void filler_entry(void) {
+	for(;;);
+}
+
+void signaller_entry(void) {
+	for(uint8_t i = 0; i < BENCH_RUNS; i++) {
+		//let the waiter block again
+		os_delay(2);
+		uint16_t start = bench_cycles();
+		os_event_signal(&event);
+		uint16_t stop = bench_cycles();
+		bench_stat_add(&signal_stat, stop - start);
+	}
+	bench_report("event_signal", BENCH_THREADS, &signal_stat);
+	bench_exit(0);
+}
+
+
+int main(void) {
+
+	bench_init();
+	bench_stat_init(&signal_stat);
+
+	os_system_init();
+
+	os_event_create(&event, OS_TAKEN);
+
+	static uint8_t signaller_stack[THREAD_STACK_SIZE];
+	static os_thread_t signaller_thread = {
+		.name = "signal  "
+	};
+
+	static uint8_t waiter_stack[THREAD_STACK_SIZE];
+	static os_thread_t waiter_thread = {
+		.name = "waiter  "
+	};
+
+#if BENCH_FILLERS > 0
+	static uint8_t filler_stack[BENCH_FILLERS][FILLER_STACK_SIZE];
+	static os_thread_t filler_thread[BENCH_FILLERS];
+
+	for(uint8_t i = 0; i < BENCH_FILLERS; i++) {
+		os_thread_createI(&filler_thread[i], WAITER_PRIO + 1 + (i % (SIGNALLER_PRIO - WAITER_PRIO - 1)),
+				filler_entry, filler_stack[i], FILLER_STACK_SIZE);
+		os_thread_suspend(&filler_thread[i]);
+	}
+#endif
+
+	os_thread_createI(&signaller_thread, SIGNALLER_PRIO, signaller_entry, signaller_stack, sizeof(signaller_stack));
+	os_thread_createI(&waiter_thread, WAITER_PRIO, waiter_entry, waiter_stack, sizeof(waiter_stack));
+
+	//os_thread_suspend enables interrupts, no tick before the threads are set up
+	hal_systick_init();
+	os_system_start();
+
+	for(;;) {
+
+	}
+}
+
+/* END */
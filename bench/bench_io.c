@@ -0,0 +1,191 @@
+/*  Title		: bench_io
+ *  Filename		: bench_io.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: charger and uart driver cycle benchmark
+ *
+ *	The bench thread runs with the systick started, the results are wall
+ *	clock cycles and include the ticks that fall in.
+ *	simulavr has no twi slave, so a lower priority bus thread plays the
+ *	twi interrupts while the bench thread waits: a call stands for the
+ *	vector, with the body of OS_ISR around the handler of the register
+ *	read fed with the statuses of a read that is acknowledged. The bus
+ *	time is not included.
+ *	charger_i2c_read: one register read, start to the thread woken up
+ *	i2c_handler: one status handled, the completion signal included
+ *	uart_send: BENCH_UART_LEN bytes at 9600 baud, busy waiting
+ *	uart_send_it: starting the same transfer from interrupts
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <hal.h>
+#include <charger.h>
+#include <bench.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#define BENCH_RUNS	16
+
+//about 8300 cycles per byte, must fit in the 16 bit cycle counter
+#define BENCH_UART_LEN	4
+
+#define CHARGER_STATUS_REG	0x13
+
+#define BENCH_PRIO	2
+#define BUS_PRIO	1
+
+#define THREAD_STACK_SIZE	128
+#define BUS_STACK_SIZE		96
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static uint8_t uart_data[BENCH_UART_LEN] = {'b', 'e', 'n', 'c'};
+
+//twi statuses of a single register read, in order
+static const uint8_t bus_script[] = {
+	TW_START,
+	TW_MT_SLAW_ACK,
+	TW_MT_DATAW_ACK,
+	TW_RSTART,
+	TW_MT_SLAR_ACK,
+	TW_MT_DATAR_NACK
+};
+
+static volatile uint8_t uart_done;
+
+//twi status of the next scripted interrupt
+static uint8_t bus_status;
+
+static bench_stat_t charger_stat;
+static bench_stat_t handler_stat;
+static bench_stat_t send_stat;
+static bench_stat_t send_it_stat;
+
+
+/**********************
+ *	PROTOTYPES
+ **********************/
+
+//twi handler of hal_i2c_reg_read_it from hal.c, entered by hand
+void hal_i2c_reg_read_isr(uint8_t status);
+
+void bus_vect(void) __attribute__((naked, noinline));
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void bus_handler(void) {
+	uint16_t t_start = bench_cycles();
+	hal_i2c_reg_read_isr(bus_status);
+	uint16_t t_stop = bench_cycles();
+	bench_stat_add(&handler_stat, t_stop - t_start);
+}
+
+//called with interrupts disabled, the call pushes the return address
+//like the hardware, then the same body as OS_ISR(TWI_vect, ...)
+void bus_vect(void) {
+	port_context_save(os_isr_context());
+	bus_handler();
+	os_isr_exit();
+}
+
+//runs when the bench thread waits for the transfer
+void bus_entry(void) {
+	for(;;) {
+		for(uint8_t i = 0; i < sizeof(bus_script); i++) {
+			bus_status = bus_script[i];
+			cli();
+			//the last status completes the transfer and wakes the reader,
+			//the reti of the resume enables the interrupts
+			bus_vect();
+		}
+	}
+}
+
+void uart_cmplt(void) {
+	uart_done = 1;
+}
+
+void bench_entry(void) {
+	static uint8_t bus_stack[BUS_STACK_SIZE];
+	static os_thread_t bus_thread = {
+		.name = "bus     "
+	};
+	uint8_t value;
+
+	//the configuration writes time out and leave the driver busy with
+	//the first one, start the reads from a reset driver
+	charger_init();
+	hal_i2c_init();
+	os_thread_create(&bus_thread, BUS_PRIO, bus_entry, bus_stack, sizeof(bus_stack));
+
+	for(uint8_t i = 0; i < BENCH_RUNS; i++) {
+		uint16_t t_start = bench_cycles();
+		charger_i2c_read(CHARGER_STATUS_REG, &value);
+		uint16_t t_stop = bench_cycles();
+		bench_stat_add(&charger_stat, t_stop - t_start);
+	}
+
+	for(uint8_t i = 0; i < BENCH_RUNS; i++) {
+		uint16_t t_start = bench_cycles();
+		hal_uart_send(uart_data, BENCH_UART_LEN);
+		uint16_t t_stop = bench_cycles();
+		bench_stat_add(&send_stat, t_stop - t_start);
+
+		uart_done = 0;
+		t_start = bench_cycles();
+		hal_uart_send_it(uart_data, BENCH_UART_LEN, uart_cmplt);
+		t_stop = bench_cycles();
+		bench_stat_add(&send_it_stat, t_stop - t_start);
+		while(!uart_done);
+	}
+
+	bench_report("charger_i2c_read", 0, &charger_stat);
+	bench_report("i2c_handler", 0, &handler_stat);
+	bench_report("uart_send", BENCH_UART_LEN, &send_stat);
+	bench_report("uart_send_it", BENCH_UART_LEN, &send_it_stat);
+	bench_exit(0);
+}
+
+
+int main(void) {
+
+	bench_init();
+	bench_stat_init(&charger_stat);
+	bench_stat_init(&handler_stat);
+	bench_stat_init(&send_stat);
+	bench_stat_init(&send_it_stat);
+
+	hal_systick_init();
+	hal_uart_init();
+	hal_i2c_init();
+	os_system_init();
+
+	static uint8_t bench_stack[THREAD_STACK_SIZE];
+	static os_thread_t bench_thread = {
+		.name = "bench   "
+	};
+
+	os_thread_createI(&bench_thread, BENCH_PRIO, bench_entry, bench_stack, sizeof(bench_stack));
+
+	os_system_start();
+
+	for(;;) {
+
+	}
+}
+
+/* END */
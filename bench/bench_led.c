@@ -0,0 +1,103 @@
+/*  Title		: bench_led
+ *  Filename		: bench_led.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: led pwm interrupts cycle benchmark
+ *
+ *	Timer1 is the cycle counter so the pwm is not started, the three
+ *	timer1 handlers are entered by hand with BENCH_LEDS_FEW then
+ *	BENCH_LEDS_MANY leds attached, alternately dimmed and bright so
+ *	that every branch is taken. The os is not needed.
+ *	led_compa: dim leds on, led_compb: bright leds on, led_ovf: period
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <hal.h>
+#include <bench.h>
+#include <avr/interrupt.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#define BENCH_RUNS	16
+
+//the leds of the board, then as many as the hal supports
+#define BENCH_LEDS_FEW	3
+#define BENCH_LEDS_MANY	16
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static bench_stat_t compa_stat;
+static bench_stat_t compb_stat;
+static bench_stat_t ovf_stat;
+
+
+/**********************
+ *	PROTOTYPES
+ **********************/
+
+//timer1 handlers from hal.c, entered by hand
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void TIMER1_OVF_vect(void);
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+//handlers return with reti, interrupts are enabled again
+static uint16_t bench_vector(void (*vector)(void)) {
+	cli();
+	uint16_t t_start = bench_cycles();
+	vector();
+	uint16_t t_stop = bench_cycles();
+	return t_stop - t_start;
+}
+
+static void bench_leds(uint8_t leds) {
+	bench_stat_init(&compa_stat);
+	bench_stat_init(&compb_stat);
+	bench_stat_init(&ovf_stat);
+	for(uint8_t i = 0; i < BENCH_RUNS; i++) {
+		bench_stat_add(&compa_stat, bench_vector(TIMER1_COMPA_vect));
+		bench_stat_add(&compb_stat, bench_vector(TIMER1_COMPB_vect));
+		bench_stat_add(&ovf_stat, bench_vector(TIMER1_OVF_vect));
+	}
+	bench_report("led_compa", leds, &compa_stat);
+	bench_report("led_compb", leds, &compb_stat);
+	bench_report("led_ovf", leds, &ovf_stat);
+}
+
+static void bench_attach(uint8_t leds) {
+	static uint8_t attached = 0;
+	while(attached < leds) {
+		uint8_t channel = hal_led_attach((uint8_t *) GPIOB, 1<<(attached % 8));
+		hal_led_set_brightness(channel, (attached % 2) ? LED_HIGH : LED_LOW);
+		attached++;
+	}
+}
+
+int main(void) {
+
+	bench_init();
+
+	bench_attach(BENCH_LEDS_FEW);
+	bench_leds(BENCH_LEDS_FEW);
+
+	bench_attach(BENCH_LEDS_MANY);
+	bench_leds(BENCH_LEDS_MANY);
+
+	bench_exit(0);
+}
+
+/* END */
@@ -0,0 +1,130 @@
+/*  Title		: bench_mutex
+ *  Filename		: bench_mutex.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: priority inversion scenario
+ *
+ *	low takes the mutex and wakes high, high wakes medium and blocks on
+ *	the mutex. With priority inheritance low finishes its critical
+ *	section before medium runs and high is blocked for about
+ *	CRITICAL_CYCLES, without it medium runs first and the blocking time
+ *	grows by MEDIUM_CYCLES.
+ *	mutex_block: cycles high waited for the mutex (param: OS_MUTEX_INHERIT)
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <hal.h>
+#include <bench.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#define HIGH_PRIO	3
+#define MEDIUM_PRIO	2
+#define LOW_PRIO	1
+
+#define CRITICAL_CYCLES	2000
+#define MEDIUM_CYCLES	20000
+
+#define THREAD_STACK_SIZE	96
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static os_mutex_t mutex;
+
+static os_event_t start_high;
+static os_event_t start_medium;
+
+static bench_stat_t block_stat;
+static bench_stat_t critical_stat;
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void high_entry(void) {
+	os_event_wait(&start_high);
+	os_event_signal(&start_medium);
+
+	uint16_t start = bench_cycles();
+	os_mutex_lock(&mutex);
+	uint16_t stop = bench_cycles();
+	bench_stat_add(&block_stat, stop - start);
+	os_mutex_unlock(&mutex);
+
+	bench_report("mutex_block", OS_MUTEX_INHERIT, &block_stat);
+	bench_report("mutex_critical", OS_MUTEX_INHERIT, &critical_stat);
+	bench_exit(0);
+}
+
+void medium_entry(void) {
+	os_event_wait(&start_medium);
+	bench_spin(MEDIUM_CYCLES);
+	for(;;) {
+		os_event_wait(&start_medium);
+	}
+}
+
+void low_entry(void) {
+	os_mutex_lock(&mutex);
+	os_event_signal(&start_high);
+	uint16_t start = bench_cycles();
+	bench_spin(CRITICAL_CYCLES);
+	bench_stat_add(&critical_stat, bench_cycles() - start);
+	os_mutex_unlock(&mutex);
+	for(;;) {
+		os_event_wait(&start_high);
+	}
+}
+
+
+int main(void) {
+
+	bench_init();
+	bench_stat_init(&block_stat);
+	bench_stat_init(&critical_stat);
+
+	os_system_init();
+
+	os_mutex_create(&mutex);
+	os_event_create(&start_high, OS_TAKEN);
+	os_event_create(&start_medium, OS_TAKEN);
+
+	static uint8_t high_stack[THREAD_STACK_SIZE];
+	static os_thread_t high_thread = {
+		.name = "high    "
+	};
+
+	static uint8_t medium_stack[THREAD_STACK_SIZE];
+	static os_thread_t medium_thread = {
+		.name = "medium  "
+	};
+
+	static uint8_t low_stack[THREAD_STACK_SIZE];
+	static os_thread_t low_thread = {
+		.name = "low     "
+	};
+
+	os_thread_createI(&high_thread, HIGH_PRIO, high_entry, high_stack, sizeof(high_stack));
+	os_thread_createI(&medium_thread, MEDIUM_PRIO, medium_entry, medium_stack, sizeof(medium_stack));
+	os_thread_createI(&low_thread, LOW_PRIO, low_entry, low_stack, sizeof(low_stack));
+
+	os_system_start();
+
+	for(;;) {
+
+	}
+}
+
+/* END */
@@ -0,0 +1,135 @@
+/*  Title		: bench_sched
+ *  Filename		: bench_sched.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: scheduler cycle benchmark
+ *
+ *	BENCH_THREADS threads run, idle and timer service (OS_TIMERS)
+ *	included: a high priority ponger, a low priority pinger and fillers
+ *	suspended in between, so a linear scan of the thread list has to
+ *	walk over all of them.
+ *	sched_signal: pinger signals -> ponger running
+ *	sched_wait: ponger waits -> pinger running
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <hal.h>
+#include <bench.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#ifndef BENCH_THREADS
+#define BENCH_THREADS	3
+#endif
+
+#define BENCH_RUNS	16
+
+#define BENCH_FILLERS	(BENCH_THREADS - 3 - OS_TIMERS)
+
+#if BENCH_FILLERS < 0
+#error "BENCH_THREADS is lower than the threads the benchmark needs"
+#endif
+
+#define PONGER_PRIO	(OS_PRIORITY_LEVELS - 1)
+#define PINGER_PRIO	1
+
+#define THREAD_STACK_SIZE	96
+//fillers are suspended before they run, their stack only holds the
+//first frame, so that 16 threads fit in the 2kB of ram
+#define FILLER_STACK_SIZE	(PORT_FRAME_LIGHT_REGS + 2)
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static os_event_t ping;
+
+static volatile uint16_t t_wait;
+static volatile uint16_t t_wake;
+
+static bench_stat_t signal_stat;
+static bench_stat_t wait_stat;
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void ponger_entry(void) {
+	for(;;) {
+		t_wait = bench_cycles();
+		os_event_wait(&ping);
+		t_wake = bench_cycles();
+	}
+}
+
+//suspended before it runs
+void filler_entry(void) {
+	for(;;);
+}
+
+void pinger_entry(void) {
+	for(uint8_t i = 0; i < BENCH_RUNS; i++) {
+		uint16_t t_signal = bench_cycles();
+		os_event_signal(&ping);
+		uint16_t t_back = bench_cycles();
+		bench_stat_add(&signal_stat, t_wake - t_signal);
+		bench_stat_add(&wait_stat, t_back - t_wait);
+	}
+	bench_report("sched_signal", BENCH_THREADS, &signal_stat);
+	bench_report("sched_wait", BENCH_THREADS, &wait_stat);
+	bench_exit(0);
+}
+
+
+int main(void) {
+
+	bench_init();
+	bench_stat_init(&signal_stat);
+	bench_stat_init(&wait_stat);
+
+	os_system_init();
+
+	os_event_create(&ping, OS_TAKEN);
+
+	static uint8_t ponger_stack[THREAD_STACK_SIZE];
+	static os_thread_t ponger_thread = {
+		.name = "ponger  "
+	};
+
+	static uint8_t pinger_stack[THREAD_STACK_SIZE];
+	static os_thread_t pinger_thread = {
+		.name = "pinger  "
+	};
+
+#if BENCH_FILLERS > 0
+	static uint8_t filler_stack[BENCH_FILLERS][FILLER_STACK_SIZE];
+	static os_thread_t filler_thread[BENCH_FILLERS];
+
+	for(uint8_t i = 0; i < BENCH_FILLERS; i++) {
+		os_thread_createI(&filler_thread[i], PINGER_PRIO + 1 + (i % (PONGER_PRIO - PINGER_PRIO - 1)),
+				filler_entry, filler_stack[i], FILLER_STACK_SIZE);
+		os_thread_suspend(&filler_thread[i]);
+	}
+#endif
+
+	os_thread_createI(&ponger_thread, PONGER_PRIO, ponger_entry, ponger_stack, sizeof(ponger_stack));
+	os_thread_createI(&pinger_thread, PINGER_PRIO, pinger_entry, pinger_stack, sizeof(pinger_stack));
+
+	os_system_start();
+
+	for(;;) {
+
+	}
+}
+
+/* END */
@@ -0,0 +1,119 @@
+/*  Title		: bench_switch
+ *  Filename		: bench_switch.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: context switch frame benchmark
+ *
+ *	A low priority thread hands the cpu to a high priority one through
+ *	both switch paths, the high priority thread always blocks voluntarily.
+ *	switch_voluntary: low signals high -> high running (light save)
+ *	switch_isr: high made ready from "interrupt", tick isr called by
+ *	hand -> high running (full save of the preempted low thread)
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <hal.h>
+#include <bench.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#define BENCH_RUNS	16
+
+#define HIGH_PRIO	(OS_PRIORITY_LEVELS - 1)
+#define LOW_PRIO	1
+
+#define THREAD_STACK_SIZE	96
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static os_event_t wake;
+static os_sem_t isr_wake;
+
+static volatile uint16_t t_wake;
+
+static bench_stat_t voluntary_stat;
+static bench_stat_t isr_stat;
+
+
+/**********************
+ *	PROTOTYPES
+ **********************/
+
+//systick interrupt from os.c, entered by hand to force a preemption
+void TIMER0_COMPA_vect(void);
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void high_entry(void) {
+	for(;;) {
+		os_event_wait(&wake);
+		t_wake = bench_cycles();
+		os_sem_wait(&isr_wake);
+		t_wake = bench_cycles();
+	}
+}
+
+void low_entry(void) {
+	for(uint8_t i = 0; i < BENCH_RUNS; i++) {
+		uint16_t t_start = bench_cycles();
+		os_event_signal(&wake);
+		bench_stat_add(&voluntary_stat, t_wake - t_start);
+
+		cli();
+		os_sem_post_fromISR(&isr_wake);
+		t_start = bench_cycles();
+		TIMER0_COMPA_vect();
+		bench_stat_add(&isr_stat, t_wake - t_start);
+	}
+	bench_report("switch_voluntary", 0, &voluntary_stat);
+	bench_report("switch_isr", 0, &isr_stat);
+	bench_exit(0);
+}
+
+
+int main(void) {
+
+	bench_init();
+	bench_stat_init(&voluntary_stat);
+	bench_stat_init(&isr_stat);
+
+	os_system_init();
+
+	os_event_create(&wake, OS_TAKEN);
+	os_sem_create(&isr_wake, 0);
+
+	static uint8_t high_stack[THREAD_STACK_SIZE];
+	static os_thread_t high_thread = {
+		.name = "high    "
+	};
+
+	static uint8_t low_stack[THREAD_STACK_SIZE];
+	static os_thread_t low_thread = {
+		.name = "low     "
+	};
+
+	os_thread_createI(&high_thread, HIGH_PRIO, high_entry, high_stack, sizeof(high_stack));
+	os_thread_createI(&low_thread, LOW_PRIO, low_entry, low_stack, sizeof(low_stack));
+
+	os_system_start();
+
+	for(;;) {
+
+	}
+}
+
+/* END */
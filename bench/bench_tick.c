@@ -0,0 +1,122 @@
+/*  Title		: bench_tick
+ *  Filename		: bench_tick.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: systick interrupt cycle benchmark
+ *
+ *	BENCH_THREADS threads run, idle and timer service (OS_TIMERS)
+ *	included: a low priority caller and fillers sleeping for a long
+ *	delay. The systick is not
+ *	started, the caller enters the tick interrupt by hand and nothing
+ *	expires, so the result should not depend on the number of delayed
+ *	threads (only the head of the delta list is touched).
+ *	tick_isr: call -> reti, full frame save and restore included
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <hal.h>
+#include <bench.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#ifndef BENCH_THREADS
+#define BENCH_THREADS	3
+#endif
+
+#define BENCH_RUNS	16
+
+#define BENCH_FILLERS	(BENCH_THREADS - 2 - OS_TIMERS)
+
+#if BENCH_FILLERS < 0
+#error "BENCH_THREADS is lower than the threads the benchmark needs"
+#endif
+
+#define CALLER_PRIO	1
+
+#define FILLER_DELAY	60000
+
+#define THREAD_STACK_SIZE	96
+//fillers only block once: first frame, then the light frame of the
+//switch and the calls made before it
+#define FILLER_STACK_SIZE	64
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static bench_stat_t tick_stat;
+
+
+/**********************
+ *	PROTOTYPES
+ **********************/
+
+//systick interrupt from os.c, entered by hand
+void TIMER0_COMPA_vect(void);
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void filler_entry(void) {
+	for(;;) {
+		os_delay(FILLER_DELAY);
+	}
+}
+
+void caller_entry(void) {
+	for(uint8_t i = 0; i < BENCH_RUNS; i++) {
+		cli();
+		uint16_t t_start = bench_cycles();
+		TIMER0_COMPA_vect();
+		uint16_t t_stop = bench_cycles();
+		bench_stat_add(&tick_stat, t_stop - t_start);
+	}
+	bench_report("tick_isr", BENCH_THREADS, &tick_stat);
+	bench_exit(0);
+}
+
+
+int main(void) {
+
+	bench_init();
+	bench_stat_init(&tick_stat);
+
+	os_system_init();
+
+	static uint8_t caller_stack[THREAD_STACK_SIZE];
+	static os_thread_t caller_thread = {
+		.name = "caller  "
+	};
+
+#if BENCH_FILLERS > 0
+	//higher priority so that they are all delayed when the caller starts
+	static uint8_t filler_stack[BENCH_FILLERS][FILLER_STACK_SIZE];
+	static os_thread_t filler_thread[BENCH_FILLERS];
+
+	for(uint8_t i = 0; i < BENCH_FILLERS; i++) {
+		os_thread_createI(&filler_thread[i], CALLER_PRIO + 1 + (i % (OS_PRIORITY_LEVELS - CALLER_PRIO - 1)),
+				filler_entry, filler_stack[i], FILLER_STACK_SIZE);
+	}
+#endif
+
+	os_thread_createI(&caller_thread, CALLER_PRIO, caller_entry, caller_stack, sizeof(caller_stack));
+
+	os_system_start();
+
+	for(;;) {
+
+	}
+}
+
+/* END */
@@ -0,0 +1,300 @@
+/*  Title		: bench_host
+ *  Filename		: bench_host.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: scheduler benchmark on the linux port
+ *
+ *	A low priority driver thread runs each benchmark against higher
+ *	priority threads and measures the wall clock time:
+ *	- signal_wait: the driver signals an event a thread waits on, two
+ *	  switches per operation
+ *	- queue: the driver sends to a queue a thread receives from
+ *	- delay: the driver sleeps one tick, through the idle thread and
+ *	  the systick handler
+ *	- isr_latency: distribution of the time from an interrupt raised by
+ *	  the driver to the waiting thread running, os_event_signal_fromISR
+ *	  and os_isr_exit
+ *	- charger: charger.c against the simulated i2c device
+ *	- mutex_inherit: the driver holds a mutex a higher priority thread
+ *	  waits for, its priority after the waiter is deleted, then after
+ *	  the waiter is lowered
+ *	- timeslice: the driver spins until a thread of its priority has
+ *	  run, which takes the systick of SIGALRM and a time slice
+ *	- pool_double_free: a block freed twice is refused while another
+ *	  one is still allocated
+ *	Results are csv lines: "name,count,ops/s" for the throughputs and
+ *	"name,count,min,p50,p99,max,mean" in ns for the latency, followed by
+ *	the log2 histogram.
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <hal.h>
+#include <hal_host.h>
+#include <charger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#define BENCH_OPS	200000
+#define BENCH_DELAYS	20000
+#define BENCH_SAMPLES	100000
+#define BENCH_BUCKETS	24
+
+#define DRIVER_PRIO	1
+#define WORKER_PRIO	4
+#define WAITER_PRIO	5
+#define LOCKER_PRIO	6
+#define LOCKER_LOWERED	2
+
+#define THREAD_STACK_SIZE	64
+
+#define QUEUE_LEN	4
+
+#define POOL_BLOCKS	4
+
+#define TIMESLICE_WAIT_NS	1000000000ULL
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static os_event_t work_event;
+static os_event_t isr_event;
+
+static uint32_t queue_buffer[QUEUE_LEN];
+static os_queue_t queue;
+
+static void * pool_buffer[POOL_BLOCKS];
+static os_pool_t pool;
+
+static os_mutex_t mutex;
+static os_event_t never_event;
+
+static os_thread_t driver_thread = {
+	.name = "driver  "
+};
+
+static volatile uint8_t spinner_ran;
+
+static uint8_t spinner_stack[THREAD_STACK_SIZE];
+static os_thread_t spinner_thread = {
+	.name = "spinner "
+};
+
+static uint8_t locker_stack[THREAD_STACK_SIZE];
+static os_thread_t locker_thread = {
+	.name = "locker  "
+};
+
+static uint64_t isr_start;
+static uint64_t latency[BENCH_SAMPLES];
+static uint32_t latency_count;
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+static uint64_t bench_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_rate(const char * name, uint32_t count, uint64_t start) {
+	uint64_t elapsed = bench_now_ns() - start;
+	printf("%s,%u,%.0f\n", name, count, count * 1e9 / elapsed);
+}
+
+static int bench_compare(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+static void bench_distribution(const char * name, uint64_t * samples, uint32_t count) {
+	uint32_t hist[BENCH_BUCKETS] = {0};
+	uint64_t sum = 0;
+	qsort(samples, count, sizeof(uint64_t), bench_compare);
+	for(uint32_t i = 0; i < count; i++) {
+		uint8_t bucket = 0;
+		for(uint64_t v = samples[i]; v && bucket < BENCH_BUCKETS-1; v >>= 1) {
+			bucket++;
+		}
+		hist[bucket]++;
+		sum += samples[i];
+	}
+	printf("%s,%u,%lu,%lu,%lu,%lu,%lu\n", name, count,
+			(unsigned long) samples[0],
+			(unsigned long) samples[count / 2],
+			(unsigned long) samples[(uint64_t) count * 99 / 100],
+			(unsigned long) samples[count - 1],
+			(unsigned long) (sum / count));
+	//bucket k holds the samples from 2^(k-1) to 2^k - 1 ns
+	for(uint8_t i = 0; i < BENCH_BUCKETS; i++) {
+		if(hist[i]) {
+			printf("  < %8lu ns %u\n", (unsigned long) 1 << i, hist[i]);
+		}
+	}
+}
+
+void worker_entry(void) {
+	for(;;) {
+		os_event_wait(&work_event);
+	}
+}
+
+void receiver_entry(void) {
+	uint32_t item;
+	for(;;) {
+		os_queue_receive(&queue, &item);
+	}
+}
+
+void waiter_entry(void) {
+	for(;;) {
+		os_event_wait(&isr_event);
+		if(latency_count < BENCH_SAMPLES) {
+			latency[latency_count++] = bench_now_ns() - isr_start;
+		}
+	}
+}
+
+void spinner_entry(void) {
+	spinner_ran = 1;
+	os_event_wait(&never_event);
+}
+
+void locker_entry(void) {
+	os_mutex_lock(&mutex);
+	os_mutex_unlock(&mutex);
+	os_event_wait(&never_event);
+}
+
+static void bench_isr(void) {
+	port_context_save(os_isr_context());
+	os_event_signal_fromISR(&isr_event);
+	os_isr_exit();
+}
+
+void driver_entry(void) {
+	uint64_t start = bench_now_ns();
+	for(uint32_t i = 0; i < BENCH_OPS; i++) {
+		os_event_signal(&work_event);
+	}
+	bench_rate("signal_wait", BENCH_OPS, start);
+
+	start = bench_now_ns();
+	for(uint32_t i = 0; i < BENCH_OPS; i++) {
+		os_queue_send(&queue, &i);
+	}
+	bench_rate("queue", BENCH_OPS, start);
+
+	start = bench_now_ns();
+	for(uint32_t i = 0; i < BENCH_DELAYS; i++) {
+		os_delay(1);
+	}
+	bench_rate("delay", BENCH_DELAYS, start);
+
+	for(uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+		isr_start = bench_now_ns();
+		port_host_irq(bench_isr);
+	}
+	bench_distribution("isr_latency", latency, latency_count);
+
+	hal_host_i2c_set(0x11, CT_HV_2A);
+	hal_host_i2c_set(0x13, CS_FAST);
+	charger_init();
+	charger_type_t type = charger_get_type();
+	charger_status_t status = charger_get_status();
+	printf("charger,%s,%s\n",
+			type == CT_HV_2A && hal_host_i2c_get(0x0B) == 0b00010010 ? "ok" : "fail",
+			status == CS_FAST ? "ok" : "fail");
+
+	//the locker runs during the delay and blocks on the mutex
+	os_mutex_lock(&mutex);
+	os_thread_create(&locker_thread, LOCKER_PRIO, locker_entry, locker_stack, sizeof(locker_stack));
+	os_delay(1);
+	uint8_t boosted = driver_thread.priority == LOCKER_PRIO;
+	os_thread_delete(&locker_thread);
+	uint8_t deleted = boosted && driver_thread.priority == DRIVER_PRIO;
+	os_thread_create(&locker_thread, LOCKER_PRIO, locker_entry, locker_stack, sizeof(locker_stack));
+	os_delay(1);
+	os_thread_set_priority(&locker_thread, LOCKER_LOWERED);
+	uint8_t lowered = driver_thread.priority == LOCKER_LOWERED;
+	os_mutex_unlock(&mutex);
+	lowered = lowered && driver_thread.priority == DRIVER_PRIO;
+	printf("mutex_inherit,%s,%s\n", deleted ? "ok" : "fail", lowered ? "ok" : "fail");
+
+	os_thread_create(&spinner_thread, DRIVER_PRIO, spinner_entry, spinner_stack, sizeof(spinner_stack));
+	uint64_t spin_start = bench_now_ns();
+	while(!spinner_ran && bench_now_ns() - spin_start < TIMESLICE_WAIT_NS);
+	printf("timeslice,%s\n", spinner_ran ? "ok" : "fail");
+
+	os_pool_create(&pool, pool_buffer, sizeof(void *), POOL_BLOCKS);
+	void * block = os_pool_alloc(&pool);
+	os_pool_alloc(&pool);
+	uint8_t refused = os_pool_free(&pool, block) == OS_SUCCESS &&
+			os_pool_free(&pool, block) == OS_ERROR && pool.used == 1;
+	printf("pool_double_free,%s\n", refused ? "ok" : "fail");
+
+	os_thread_list();
+	exit(type == CT_HV_2A && status == CS_FAST && deleted && lowered && refused && spinner_ran ? 0 : 1);
+}
+
+
+int main(void) {
+
+	hal_systick_init();
+	hal_uart_init();
+	hal_i2c_init();
+	os_system_init();
+
+	os_event_create(&work_event, OS_TAKEN);
+	os_event_create(&isr_event, OS_TAKEN);
+	os_queue_create(&queue, queue_buffer, sizeof(uint32_t), QUEUE_LEN);
+	os_mutex_create(&mutex);
+	os_event_create(&never_event, OS_TAKEN);
+
+	static uint8_t driver_stack[THREAD_STACK_SIZE];
+
+	static uint8_t worker_stack[THREAD_STACK_SIZE];
+	static os_thread_t worker_thread = {
+		.name = "worker  "
+	};
+
+	static uint8_t receiver_stack[THREAD_STACK_SIZE];
+	static os_thread_t receiver_thread = {
+		.name = "receiver"
+	};
+
+	static uint8_t waiter_stack[THREAD_STACK_SIZE];
+	static os_thread_t waiter_thread = {
+		.name = "waiter  "
+	};
+
+	os_thread_createI(&driver_thread, DRIVER_PRIO, driver_entry, driver_stack, sizeof(driver_stack));
+	os_thread_createI(&worker_thread, WORKER_PRIO, worker_entry, worker_stack, sizeof(worker_stack));
+	os_thread_createI(&receiver_thread, WORKER_PRIO, receiver_entry, receiver_stack, sizeof(receiver_stack));
+	os_thread_createI(&waiter_thread, WAITER_PRIO, waiter_entry, waiter_stack, sizeof(waiter_stack));
+
+	os_system_start();
+
+	for(;;) {
+
+	}
+}
+
+/* END */
@@ -0,0 +1,45 @@
+/*  Title       : atmega328p
+ *  Filename    : atmega328p.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : registers used by the os outside of the hal, for the
+ *                linux port
+ */
+
+#ifndef ATMEGA328P_H
+#define ATMEGA328P_H
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/**********************
+ *  CONSTANTS
+ **********************/
+
+#define INFO	0
+#define VERBOSE 1
+
+#define DEBUG INFO
+
+#define SMCR	port_host_smcr
+#define SMCR_SE	0U
+
+
+/**********************
+ *  VARIABLES
+ **********************/
+
+extern volatile uint8_t port_host_smcr;
+
+
+#endif /* ATMEGA328P_H */
+
+/* END */
@@ -0,0 +1,42 @@
+/*  Title       : interrupt
+ *  Filename    : interrupt.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : interrupt handlers for the linux port, raised with
+ *                port_host_irq
+ */
+
+#ifndef AVR_INTERRUPT_H
+#define AVR_INTERRUPT_H
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <port.h>
+
+
+/**********************
+ *  CONSTANTS
+ **********************/
+
+#define TIMER0_COMPA_vect_num	14
+
+
+/**********************
+ *  MACROS
+ **********************/
+
+#define ISR_NAKED
+
+#define ISR(vector, ...) \
+    void vector(void); \
+    void vector(void)
+
+
+#endif /* AVR_INTERRUPT_H */
+
+/* END */
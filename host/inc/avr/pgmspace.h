@@ -0,0 +1,36 @@
+/*  Title       : pgmspace
+ *  Filename    : pgmspace.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : flash constants for the linux port, a single address space
+ */
+
+#ifndef AVR_PGMSPACE_H
+#define AVR_PGMSPACE_H
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <stdint.h>
+
+
+/**********************
+ *  MACROS
+ **********************/
+
+#define PROGMEM
+
+#define pgm_read_byte(addr) \
+    (*(const uint8_t *) (addr))
+
+#define pgm_read_word(addr) \
+    (*(const uint16_t *) (addr))
+
+
+#endif /* AVR_PGMSPACE_H */
+
+/* END */
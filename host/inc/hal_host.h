@@ -0,0 +1,34 @@
+/*  Title       : hal_host
+ *  Filename    : hal_host.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : simulated peripherals of the linux port
+ */
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <stdint.h>
+
+#include <hal.h>
+
+
+/**********************
+ *  PROTOTYPES
+ **********************/
+
+/* registers of the i2c device, a single one answers every address */
+void hal_host_i2c_set(uint8_t reg, uint8_t value);
+uint8_t hal_host_i2c_get(uint8_t reg);
+
+
+#endif /* HAL_HOST_H */
+
+/* END */
@@ -0,0 +1,131 @@
+/*  Title       : port
+ *  Filename    : port.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : operating system port for linux (ucontext)
+ *
+ *  Threads are ucontexts with their own host stack, the avr stack given
+ *  to port_context_init is only painted. Interrupts are a flag: handlers
+ *  raised while it is cleared are pended and run by the next sei(),
+ *  like the avr runs them after the next instruction. The systick only
+ *  fires while the idle thread sleeps, so a computing thread is never
+ *  preempted by it and time advances by whole ticks.
+ */
+
+#ifndef PORT_H
+#define PORT_H
+
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <stdint.h>
+#include <ucontext.h>
+
+#include <atmega328p.h>
+
+/**********************
+ *  CONSTANTS
+ **********************/
+
+#define PORT_FRAME_FULL		0
+#define PORT_FRAME_LIGHT	1
+
+/* host stack of each thread */
+#ifndef PORT_HOST_STACK_SIZE
+#define PORT_HOST_STACK_SIZE	(64*1024)
+#endif
+
+
+/**********************
+ *  MACROS
+ **********************/
+
+/* the avr needs naked functions to switch inside them, ucontext does
+ * not and a naked x86 function cannot have a c body */
+#define naked	__noinline__
+
+#define cli() \
+    (port_host_irq_enabled = 0)
+
+#define sei() \
+    port_host_sei()
+
+#define nop()
+
+#define port_sleep() \
+    port_host_sleep()
+
+#define port_irq_save(flags) \
+    (flags) = port_host_irq_enabled; \
+    cli()
+
+#define port_irq_restore(flags) \
+    if(flags) { \
+        sei(); \
+    }
+
+//the running context is the one switched from by port_context_resume
+#define port_context_save(ctx) \
+    (ctx)->frame = PORT_FRAME_FULL
+
+#define port_context_save_light(ctx) \
+    cli(); \
+    (ctx)->frame = PORT_FRAME_LIGHT
+
+//switch to ctx (if it is not running) then enable the interrupts
+#define port_context_resume(ctx) \
+    port_host_resume(ctx)
+
+
+/**********************
+ *  TYPEDEFS
+ **********************/
+
+typedef struct port_context {
+    ucontext_t uc;
+    void * stack;
+    void (*entry)(void);
+    uint8_t frame;
+}port_context_t;
+
+
+/**********************
+ *  VARIABLES
+ **********************/
+
+extern volatile uint8_t port_host_irq_enabled;
+
+
+/**********************
+ *  PROTOTYPES
+ **********************/
+
+void port_host_sei(void);
+
+void port_host_sleep(void);
+
+void port_host_resume(port_context_t * ctx);
+
+void port_host_context_init(port_context_t * ctx, void (*entry)(void));
+
+void port_host_irq(void (*handler)(void));
+
+void port_host_irq_defer(void (*handler)(void));
+
+void port_host_tick_start(uint32_t period_us);
+
+static inline void port_context_init(port_context_t* ctx, void (*entry)(void), uint8_t * stack, uint16_t stack_size) {
+	(void) stack;
+	(void) stack_size;
+	port_host_context_init(ctx, entry);
+}
+
+
+#endif /* PORT_H */
+
+/* END */
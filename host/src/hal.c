@@ -0,0 +1,257 @@
+/*  Title		: HAL
+ *  Filename		: hal.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: hardware abstraction layer for the linux port
+ *
+ *	The uart writes to stdout. The i2c bus has a single device made of
+ *	256 registers, transfers complete when the cpu next sleeps. The
+ *	systick is raised by SIGALRM every tick of real time, so threads
+ *	are preempted and time sliced, and the idle thread skips the time
+ *	it would sleep with one more tick. The deep sleep modes are never
+ *	selected.
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <hal.h>
+#include <hal_host.h>
+#include <os.h>
+
+#include <stdio.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#define SYSTICK_US_PER_TICK	((uint32_t) HAL_SYSTICK_COUNTS * HAL_SYSTICK_PRESCALER / (F_CPU / 1000000UL))
+
+
+/**********************
+ *	TYPEDEFS
+ **********************/
+
+typedef struct hal_host_i2c {
+	uint8_t regs[256];
+	uint8_t busy;
+	void (*tfr_cplt)(void);
+}hal_host_i2c_t;
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static hal_host_i2c_t i2c;
+
+static void (*uart_tx_cmplt)(void);
+
+static hal_systick_t system_tick;
+
+static uint8_t systick_stretched;
+static hal_systick_t systick_stretch;
+
+static uint8_t sleep_active;
+static hal_systick_t sleep_start;
+static hal_systick_t sleep_residency[HAL_SLEEP_MODES];
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+/* hal delay */
+
+void hal_delay(uint32_t delay_ms) {
+	(void) delay_ms;
+}
+
+
+/* hal uart */
+
+void hal_uart_init(void) {
+	uart_tx_cmplt = NULL;
+}
+
+void hal_uart_send_char(uint8_t data) {
+	putchar(data);
+}
+
+//the strings sent by hal_print end with their terminator
+void hal_uart_send(uint8_t * data, uint16_t len) {
+	for(uint16_t i = 0; i < len; i++) {
+		if(data[i]) {
+			putchar(data[i]);
+		}
+	}
+	fflush(stdout);
+}
+
+//bodies of OS_ISR, os_isr_exit resumes the interrupted thread
+static void hal_host_uart_tx_isr(void) {
+	port_context_save(os_isr_context());
+	if(uart_tx_cmplt) {
+		uart_tx_cmplt();
+	}
+	os_isr_exit();
+}
+
+//the transfers are written at once
+void hal_uart_flush(void) {
+}
+
+void hal_uart_send_it(uint8_t * data, uint16_t len, void (*tx_cmplt)(void)) {
+	hal_uart_send(data, len);
+	uart_tx_cmplt = tx_cmplt;
+	port_host_irq_defer(hal_host_uart_tx_isr);
+}
+
+
+/* hal i2c */
+
+void hal_i2c_init(void) {
+	i2c.busy = 0;
+}
+
+void hal_host_i2c_set(uint8_t reg, uint8_t value) {
+	i2c.regs[reg] = value;
+}
+
+uint8_t hal_host_i2c_get(uint8_t reg) {
+	return i2c.regs[reg];
+}
+
+static void hal_host_i2c_isr(void) {
+	port_context_save(os_isr_context());
+	i2c.busy = 0;
+	if(i2c.tfr_cplt) {
+		i2c.tfr_cplt();
+	}
+	os_isr_exit();
+}
+
+void hal_i2c_reg_write_it(uint8_t address, uint8_t reg, uint8_t * data, uint16_t len, void (*tfr_cplt)(void)) {
+	(void) address;
+	if(i2c.busy) {
+		return;
+	}
+	i2c.busy = 1;
+	for(uint16_t i = 0; i < len; i++) {
+		i2c.regs[(uint8_t) (reg + i)] = data[i];
+	}
+	i2c.tfr_cplt = tfr_cplt;
+	port_host_irq_defer(hal_host_i2c_isr);
+}
+
+void hal_i2c_reg_read_it(uint8_t address, uint8_t reg, uint8_t * data, uint16_t len, void (*tfr_cplt)(void)) {
+	(void) address;
+	if(i2c.busy) {
+		return;
+	}
+	i2c.busy = 1;
+	for(uint16_t i = 0; i < len; i++) {
+		data[i] = i2c.regs[(uint8_t) (reg + i)];
+	}
+	i2c.tfr_cplt = tfr_cplt;
+	port_host_irq_defer(hal_host_i2c_isr);
+}
+
+
+/* hal systick */
+
+//taken once the interrupts are enabled by the start of the system
+void hal_systick_init(void) {
+	system_tick = 0;
+	systick_stretched = 0;
+	port_host_tick_start(SYSTICK_US_PER_TICK);
+}
+
+hal_systick_t hal_systick_get(void) {
+	return system_tick;
+}
+
+hal_systick_t hal_systick_getI(void) {
+	return system_tick;
+}
+
+uint16_t hal_systick_get16(void) {
+	return (uint16_t) system_tick;
+}
+
+uint32_t hal_timestamp_us(void) {
+	return system_tick * SYSTICK_US_PER_TICK;
+}
+
+void hal_systick_inc(void) {
+	system_tick++;
+}
+
+uint32_t hal_systick_countsI(void) {
+	return system_tick * HAL_SYSTICK_COUNTS;
+}
+
+uint32_t hal_systick_stampI(void) {
+	return system_tick << 8;
+}
+
+//the next systick covers all the stretched ticks
+void hal_systick_stretchI(hal_systick_t ticks) {
+	if(systick_stretched) {
+		return;
+	}
+	if(ticks > HAL_SYSTICK_MAX_STRETCH) {
+		ticks = HAL_SYSTICK_MAX_STRETCH;
+	}
+	systick_stretch = ticks;
+	systick_stretched = 1;
+}
+
+//no time passes before the systick
+hal_systick_t hal_systick_unstretchI(uint8_t expired) {
+	if(!systick_stretched) {
+		return 0;
+	}
+	systick_stretched = 0;
+	if(!expired) {
+		return 0;
+	}
+	system_tick += systick_stretch;
+	return systick_stretch;
+}
+
+uint8_t hal_systick_stretchedI(void) {
+	return systick_stretched;
+}
+
+
+/* hal sleep */
+
+hal_sleep_mode_t hal_sleep_selectI(hal_systick_t ticks) {
+	(void) ticks;
+	return HAL_SLEEP_IDLE;
+}
+
+void hal_sleep_startI(hal_sleep_mode_t mode, hal_systick_t ticks) {
+	(void) mode;
+	(void) ticks;
+	sleep_active = 1;
+	sleep_start = system_tick;
+}
+
+hal_systick_t hal_sleep_exitI(void) {
+	if(sleep_active) {
+		sleep_active = 0;
+		sleep_residency[HAL_SLEEP_IDLE] += system_tick - sleep_start;
+	}
+	return 0;
+}
+
+hal_systick_t hal_sleep_residency(hal_sleep_mode_t mode) {
+	return sleep_residency[mode];
+}
+
+/* END */
@@ -0,0 +1,207 @@
+/*  Title		: port
+ *  Filename		: port.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: operating system port for linux (ucontext)
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <port.h>
+#include <avr/interrupt.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#define PORT_HOST_IRQ_LEN	16
+
+
+/**********************
+ *	TYPEDEFS
+ **********************/
+
+typedef struct port_host_irq_queue {
+	void (*handler[PORT_HOST_IRQ_LEN])(void);
+	uint8_t head;
+	uint8_t count;
+}port_host_irq_queue_t;
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+volatile uint8_t port_host_irq_enabled;
+
+volatile uint8_t port_host_smcr;
+
+//context of the running thread, NULL before the system starts
+static port_context_t * port_current;
+
+static ucontext_t port_main;
+
+//raised, run as soon as the interrupts are enabled
+static port_host_irq_queue_t irq_pending;
+
+//peripheral completions, run when the cpu sleeps
+static port_host_irq_queue_t irq_deferred;
+
+//systick raised by SIGALRM while the interrupts were disabled
+static volatile sig_atomic_t tick_pending;
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+//systick handler of the os
+void TIMER0_COMPA_vect(void);
+
+static void port_host_queue_push(port_host_irq_queue_t * queue, void (*handler)(void)) {
+	if(queue->count == PORT_HOST_IRQ_LEN) {
+		fprintf(stderr, "port: interrupt queue full\n");
+		exit(1);
+	}
+	queue->handler[(queue->head + queue->count) % PORT_HOST_IRQ_LEN] = handler;
+	queue->count++;
+}
+
+static void (*port_host_queue_pop(port_host_irq_queue_t * queue))(void) {
+	void (*handler)(void) = queue->handler[queue->head];
+	queue->head = (queue->head + 1) % PORT_HOST_IRQ_LEN;
+	queue->count--;
+	return handler;
+}
+
+//run a handler like the hardware: interrupts disabled, enabled by reti
+static void port_host_isr(void (*handler)(void)) {
+	port_host_irq_enabled = 0;
+	handler();
+	port_host_irq_enabled = 1;
+}
+
+//the queues are only touched with the interrupts disabled, SIGALRM
+//takes the systick at once only when they are enabled
+void port_host_sei(void) {
+	for(;;) {
+		port_host_irq_enabled = 0;
+		if(tick_pending) {
+			tick_pending = 0;
+			port_host_isr(TIMER0_COMPA_vect);
+		} else if(irq_pending.count) {
+			port_host_isr(port_host_queue_pop(&irq_pending));
+		} else {
+			port_host_irq_enabled = 1;
+			//a tick raised before the interrupts were enabled
+			if(!tick_pending) {
+				return;
+			}
+		}
+	}
+}
+
+//raise an interrupt, taken immediately if they are enabled
+void port_host_irq(void (*handler)(void)) {
+	uint8_t enabled = port_host_irq_enabled;
+	port_host_irq_enabled = 0;
+	port_host_queue_push(&irq_pending, handler);
+	if(enabled) {
+		port_host_sei();
+	}
+}
+
+//raise an interrupt once the cpu goes to sleep (end of a transfer)
+void port_host_irq_defer(void (*handler)(void)) {
+	uint8_t enabled = port_host_irq_enabled;
+	port_host_irq_enabled = 0;
+	port_host_queue_push(&irq_deferred, handler);
+	if(enabled) {
+		port_host_sei();
+	}
+}
+
+//the systick interrupts the running thread, the switch it may take
+//leaves the signal frame on the stack of that thread until it resumes
+static void port_host_alarm(int sig) {
+	(void) sig;
+	if(port_host_irq_enabled) {
+		port_host_isr(TIMER0_COMPA_vect);
+	} else {
+		tick_pending = 1;
+	}
+}
+
+//real time systick every period_us, on top of the ticks of the sleeps
+void port_host_tick_start(uint32_t period_us) {
+	struct sigaction sa = {0};
+	sa.sa_handler = port_host_alarm;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &sa, NULL);
+	struct itimerval timer = {
+		.it_interval = {.tv_sec = 0, .tv_usec = period_us},
+		.it_value = {.tv_sec = 0, .tv_usec = period_us}
+	};
+	setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+//called with interrupts disabled, woken by the deferred interrupts
+//or else by the next systick
+void port_host_sleep(void) {
+	port_host_smcr = 0;
+	while(irq_deferred.count) {
+		port_host_queue_push(&irq_pending, port_host_queue_pop(&irq_deferred));
+	}
+	if(irq_pending.count == 0 && !tick_pending) {
+		port_host_queue_push(&irq_pending, TIMER0_COMPA_vect);
+	}
+	port_host_sei();
+}
+
+void port_host_resume(port_context_t * ctx) {
+	port_context_t * prev = port_current;
+	port_current = ctx;
+	if(prev == NULL) {
+		swapcontext(&port_main, &(ctx->uc));
+	} else if(prev != ctx) {
+		swapcontext(&(prev->uc), &(ctx->uc));
+	}
+	//resumed by the reti of the frame
+	port_host_sei();
+}
+
+static void port_host_entry(void) {
+	port_host_sei();
+	port_current->entry();
+	fprintf(stderr, "port: thread entry returned\n");
+	exit(1);
+}
+
+void port_host_context_init(port_context_t * ctx, void (*entry)(void)) {
+	if(ctx->stack == NULL) {
+		ctx->stack = malloc(PORT_HOST_STACK_SIZE);
+		if(ctx->stack == NULL) {
+			fprintf(stderr, "port: no memory for the stack\n");
+			exit(1);
+		}
+	}
+	ctx->entry = entry;
+	ctx->frame = PORT_FRAME_LIGHT;
+	getcontext(&(ctx->uc));
+	ctx->uc.uc_stack.ss_sp = ctx->stack;
+	ctx->uc.uc_stack.ss_size = PORT_HOST_STACK_SIZE;
+	ctx->uc.uc_link = NULL;
+	makecontext(&(ctx->uc), port_host_entry, 0);
+}
+
+/* END */
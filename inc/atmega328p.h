@@ -123,7 +123,8 @@
 #define SPH     _IO_BYTE(0x5E)
 #define SREG    _IO_BYTE(0x5F)
 
-#define WDTCSR  _MMIO_BYTE(0x60)
+#define WDTCSR_ADDR	0x60
+#define WDTCSR  _MMIO_BYTE(WDTCSR_ADDR)
 #define CLKPR   _MMIO_BYTE(0x61)
 
 
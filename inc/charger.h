@@ -2,6 +2,7 @@
 #define CHARGER_H
 
 #include <stdint.h>
+#include <os.h>
 
 
 typedef enum charger_type {
@@ -25,13 +26,14 @@ typedef enum charger_status {
 	CS_FAST		= 0x60,
 	CS_CONST	= 0x80,
 	CS_DONE		= 0xA0,
+	CS_UNKNOWN	= 0xFF,	//not a register value, the read failed
 }charger_status_t;
 
 
 
-void charger_i2c_write(uint8_t reg, uint8_t data);
+os_error_t charger_i2c_write(uint8_t reg, uint8_t data);
 
-uint8_t charger_i2c_read(uint8_t reg);
+os_error_t charger_i2c_read(uint8_t reg, uint8_t * value);
 
 
 void charger_init(void);
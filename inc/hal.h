@@ -19,8 +19,8 @@
 
 #include <stdint.h>
 
-#include "atmega328p.h"
-#include "port.h"
+#include <atmega328p.h>
+#include <port.h>
 
 /**********************
  *  CONSTANTS
@@ -29,6 +29,26 @@
 #define HAL_GPIO_OUT    1
 #define HAL_GPIO_IN     0
 
+/* systick: timer counts per tick at clk/HAL_SYSTICK_PRESCALER */
+#define HAL_SYSTICK_COUNTS	250
+#define HAL_SYSTICK_PRESCALER	64
+
+/* longest systick stretch in ticks (8 bit timer at clk/1024) */
+#define HAL_SYSTICK_MAX_STRETCH 16
+
+/* no deadline */
+#define HAL_SYSTICK_FOREVER	0xFFFFFFFF
+
+/* deepest sleep mode the idle thread may select (hal_sleep_mode_t) */
+#ifndef HAL_SLEEP_DEEPEST
+#define HAL_SLEEP_DEEPEST	HAL_SLEEP_DOWN
+#endif
+
+/* 32.768kHz crystal on TOSC1/2 clocking timer2, enables power-save */
+#ifndef HAL_SLEEP_TIMER2_ASYNC
+#define HAL_SLEEP_TIMER2_ASYNC	0
+#endif
+
 
 
 
@@ -73,10 +93,10 @@
 
 /* hal sleep */
 
+/* the mode is the one programmed by hal_sleep_startI */
 #define hal_sleep_enter()   \
-    SMCR = 1;               \
-    asm volatile (          \
-        "sleep" )           
+    SMCR |= 1<<SMCR_SE;     \
+    port_sleep()
 
 #define hal_sleep_disable() \
     SMCR = 0
@@ -94,6 +114,15 @@ typedef enum hal_error {
 
 typedef uint32_t hal_systick_t;
 
+/* sleep modes from the lightest, all but idle stop the systick timer */
+typedef enum hal_sleep_mode {
+	HAL_SLEEP_IDLE,		//cpu stopped
+	HAL_SLEEP_ADC,		//adc noise reduction, woken by the conversion
+	HAL_SLEEP_SAVE,		//power-save, woken by timer2 (async crystal)
+	HAL_SLEEP_DOWN,		//power-down, woken by the watchdog or INTx
+	HAL_SLEEP_MODES
+}hal_sleep_mode_t;
+
 typedef enum i2c_dir {
     HAL_I2C_READ = 0x0,
     HAL_I2C_WRITE = 0x1,
@@ -118,9 +147,13 @@ void hal_uart_init(void);
 void hal_uart_send_char(uint8_t data);
 void hal_uart_send(uint8_t * data, uint16_t len);
 void hal_uart_send_it(uint8_t * data, uint16_t len, void (*tx_cmplt)(void));
+void hal_uart_flush(void);
 uint8_t hal_uart_recv_char(void);
 void hal_uart_recv(uint8_t * data, uint16_t len);
 void hal_uart_recv_it(uint8_t * data, uint16_t len, void (*rx_cmplt)(void));
+//interrupt handlers, the vectors are in os.c (OS_ISR)
+void hal_uart_tx_isr(void);
+void hal_uart_rx_isr(void);
 
 /* hal pwm */
 typedef enum hal_led_brightness {
@@ -145,6 +178,7 @@ void hal_i2c_write_it(uint8_t address, uint8_t * data, uint16_t len, void (*tfr_
 void hal_i2c_read_it(uint8_t address, uint8_t * data, uint16_t len, void (*tfr_cplt)(void));
 void hal_i2c_reg_write_it(uint8_t address, uint8_t reg, uint8_t * data, uint16_t len, void (*tfr_cplt)(void));
 void hal_i2c_reg_read_it(uint8_t address, uint8_t reg, uint8_t * data, uint16_t len, void (*tfr_cplt)(void));
+void hal_i2c_isr(void);
 
 /* hal spi */
 void hal_spi_init(uint8_t cpol, uint8_t cpha, uint8_t lsb_first);
@@ -154,12 +188,26 @@ void hal_spi_reg_write(uint8_t addr, uint8_t * data, uint16_t len);
 void hal_spi_reg_read(uint8_t addr, uint8_t * data, uint16_t len);
 void hal_spi_reg_write_it(uint8_t addr, uint8_t * data, uint16_t len, void (*tfr_cplt)(void));
 void hal_spi_reg_read_it(uint8_t addr, uint8_t * data, uint16_t len, void (*tfr_cplt)(void));
+void hal_spi_isr(void);
 
 /* hal systick */
 void hal_systick_init(void);
 hal_systick_t hal_systick_get(void);
 hal_systick_t hal_systick_getI(void);
+uint16_t hal_systick_get16(void);
+uint32_t hal_timestamp_us(void);
 void hal_systick_inc(void);
+uint32_t hal_systick_countsI(void);
+uint32_t hal_systick_stampI(void);
+void hal_systick_stretchI(hal_systick_t ticks);
+hal_systick_t hal_systick_unstretchI(uint8_t expired);
+uint8_t hal_systick_stretchedI(void);
+
+/* hal sleep */
+hal_sleep_mode_t hal_sleep_selectI(hal_systick_t ticks);
+void hal_sleep_startI(hal_sleep_mode_t mode, hal_systick_t ticks);
+hal_systick_t hal_sleep_exitI(void);
+hal_systick_t hal_sleep_residency(hal_sleep_mode_t mode);
 
 
 
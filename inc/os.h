@@ -19,6 +19,7 @@
 
 #include <port.h>
 #include <hal.h>
+#include <os_trace.h>
 
 /**********************
  *  CONSTANTS
@@ -27,11 +28,116 @@
 #define OS_THREAD_NAME_LEN	8
 #define OS_EVENT_NAME_LEN	8
 
+/* unused stack bytes hold this value */
+#define OS_STACK_PATTERN	0xA5
+
+/* number of priority levels, one bit each in the ready bitmap */
+#define OS_PRIORITY_LEVELS	8
+
+/* owners of a contended mutex inherit the priority of the waiters */
+#ifndef OS_MUTEX_INHERIT
+#define OS_MUTEX_INHERIT	1
+#endif
+
+/* stop the periodic systick while idle, wake up at the next deadline */
+#ifndef OS_TICKLESS_IDLE
+#define OS_TICKLESS_IDLE	1
+#endif
+
+/* ticks a thread may run before yielding to a ready thread of equal
+ * priority, 0 disables time slicing */
+#ifndef OS_TIMESLICE
+#define OS_TIMESLICE		10
+#endif
+
+/* per thread cpu time, measured at each context switch */
+#ifndef OS_CPU_STATS
+#define OS_CPU_STATS		1
+#endif
+
+/* software timers, callbacks run in a service thread
+ * off by default: the thread and its stack cost ram even if unused */
+#ifndef OS_TIMERS
+#define OS_TIMERS		0
+#endif
+
+#define OS_TIMER_PRIORITY	(OS_PRIORITY_LEVELS - 1)
+
+/* shared by all the timer callbacks */
+#ifndef OS_TIMER_STACK_SIZE
+#define OS_TIMER_STACK_SIZE	128
+#endif
+
 
 /**********************
  *  MACROS
  **********************/
 
+/**
+ * static thread table, one X(name, priority, entry, stack_size) entry per
+ * thread in decreasing priority order:
+ *
+ *	#define APP_THREADS(X) \
+ *		X(feedback, 3, feedback_entry, 256) \
+ *		X(control, 2, control_entry, 256)
+ *
+ *	OS_THREAD_TABLE(APP_THREADS);
+ *
+ * allocates os_stack_<name>, the os_threads array already chained by
+ * priority and the entry points, then call OS_THREAD_TABLE_INIT() right
+ * after os_system_init, os_thread(name) gives the thread object
+ **/
+#define OS_THREAD_TABLE(table)						\
+	enum { table(OS_THREAD_TABLE_ID) OS_THREAD_COUNT };		\
+	table(OS_THREAD_TABLE_STACK)					\
+	os_thread_t os_threads[OS_THREAD_COUNT];			\
+	os_thread_t os_threads[OS_THREAD_COUNT] = {			\
+		table(OS_THREAD_TABLE_THREAD)				\
+	};								\
+	void (* const os_thread_entries[OS_THREAD_COUNT])(void) = {	\
+		table(OS_THREAD_TABLE_ENTRY)				\
+	}
+
+#define OS_THREAD_TABLE_INIT() \
+	os_thread_table_init(os_threads, os_thread_entries, OS_THREAD_COUNT)
+
+/**
+ * interrupt vector whose handler can wake threads with the _fromISR
+ * calls: the handler runs on the full frame of the interrupted thread
+ * and the resume of os_isr_exit takes the place of its reti
+ **/
+#define OS_ISR(vector, handler)						\
+	ISR(vector, ISR_NAKED) {					\
+		port_context_save(os_isr_context());			\
+		handler();						\
+		os_isr_exit();						\
+	}
+
+#define os_thread(thd) \
+	(&os_threads[OS_THREAD_ID_##thd])
+
+#define OS_THREAD_TABLE_ID(thd, prio, entry, size) \
+	OS_THREAD_ID_##thd,
+
+#define OS_THREAD_TABLE_STACK(thd, prio, entry, size) \
+	static uint8_t os_stack_##thd[size];
+
+//the last thread is linked to the system threads at init
+#define OS_THREAD_TABLE_THREAD(thd, prio, entry, size)		\
+	[OS_THREAD_ID_##thd] = {					\
+		.name = #thd,						\
+		.next = &os_threads[OS_THREAD_ID_##thd + 1],		\
+		.priority = (prio),					\
+		.base_priority = (prio),				\
+		.stack = os_stack_##thd,				\
+		.stack_size = (size),					\
+		.state = OS_READY					\
+	},
+
+#define OS_THREAD_TABLE_ENTRY(thd, prio, entry, size) \
+	entry,
+
+
 
 /**********************
  *  TYPEDEFS
@@ -41,10 +147,17 @@ typedef enum os_thread_state {
 	OS_RUNNING,	//Thread is currently running
 	OS_READY,	//Thread is ready to run
 	OS_SUSPENDED,	//Thread is suspended (waiting on scheduled time)
-	OS_WAITING,	//Thread is waiting for an event
+	OS_WAITING,	//Thread is waiting for an event, mutex, semaphore or queue
 	OS_DISABLED	//Thread is disabled
 }os_thread_state_t;
 
+typedef enum os_error {
+	OS_SUCCESS,
+	OS_ERROR,
+	OS_BUSY,
+	OS_TIMEOUT
+}os_error_t;
+
 typedef enum os_event_state {
 	OS_FREE,
 	OS_TAKEN
@@ -54,6 +167,7 @@ typedef enum os_event_state {
 
 /**
  * higher threads have higher priority
+ * valid priorities range from 0 (idle) to OS_PRIORITY_LEVELS-1
  **/
 typedef uint8_t os_priority_t;
 
@@ -61,21 +175,106 @@ typedef struct os_thread os_thread_t;
 
 typedef struct os_event os_event_t;
 
+typedef struct os_mutex os_mutex_t;
+
+typedef struct os_sem os_sem_t;
+
+typedef struct os_queue os_queue_t;
+
+typedef struct os_timer os_timer_t;
+
+typedef struct os_pool os_pool_t;
+
 struct os_event {
 	uint8_t name[OS_EVENT_NAME_LEN];
 	os_event_state_t state;
 	os_thread_t * owner;
+	os_thread_t * waiting;	//waiting threads by decreasing priority
+};
+
+/**
+ * recursive mutex with ownership, the owner inherits the priority
+ * of the highest waiting thread until it releases all its mutexes
+ **/
+struct os_mutex {
+	os_thread_t * owner;
+	os_thread_t * waiting;	//waiting threads by decreasing priority
+	uint8_t count;		//recursion count of the owner
+};
+
+struct os_sem {
+	uint16_t count;
+	os_thread_t * waiting;	//waiting threads by decreasing priority
+};
+
+/**
+ * fifo of fixed size items stored in a caller supplied buffer
+ * of item_size*length bytes
+ **/
+struct os_queue {
+	uint8_t * buffer;
+	uint8_t item_size;
+	uint8_t length;		//capacity in items
+	uint8_t count;		//items in the queue
+	uint8_t head;		//index of the oldest item
+	os_thread_t * senders;	//threads waiting for space
+	os_thread_t * receivers;	//threads waiting for an item
+};
+
+/**
+ * fixed size blocks carved from a caller supplied buffer of
+ * block_size*count bytes, free blocks are linked through their first bytes
+ **/
+struct os_pool {
+	uint8_t * buffer;
+	uint8_t * free;		//first free block
+	uint8_t block_size;	//at least sizeof(void *)
+	uint8_t count;		//blocks in the pool
+	uint8_t used;		//blocks allocated
+	uint8_t peak;		//highest used
+	uint16_t failed;	//allocations refused for lack of blocks
+};
+
+/**
+ * software timer, the callback is called from the timer service thread
+ * period is 0 for one-shot timers
+ **/
+struct os_timer {
+	os_timer_t * next;		//link in the delta list of armed timers
+	os_timer_t * pending_next;	//link in the list of expired timers
+	hal_systick_t remaining;	//ticks after the previous armed timer
+	hal_systick_t period;
+	void (*callback)(void * arg);
+	void * arg;
+	uint8_t armed;			//in the delta list
+	uint8_t pending;		//expired, callback not run yet
 };
 
 struct os_thread {
 	uint8_t name[OS_THREAD_NAME_LEN];
 	os_thread_t * next;
-	os_priority_t priority;
+	os_thread_t * queue_next;	//link in the ready list or a wait list
+	os_priority_t priority;		//effective priority
+	os_priority_t base_priority;	//priority without inheritance
 	port_context_t context;
+	uint8_t * stack;
+	uint16_t stack_size;
 	os_thread_state_t state;
-	hal_systick_t suspended_timer;
-	os_event_t * waiting_event;
-	uint8_t existing;
+	hal_systick_t suspended_timer;	//ticks after the previous suspended thread
+	os_thread_t * delay_next;
+	os_thread_t ** wait_list;	//wait list the thread is in
+	os_error_t wait_status;		//result of the last timed wait
+	uint8_t timed;			//waiting with a timeout (also in the delta list)
+	os_mutex_t * waiting_mutex;
+	uint8_t mutex_held;
+	uint8_t suspend;		//parked by os_thread_suspend
+#if OS_TRACE
+	uint8_t id;			//thread number in the trace
+#endif
+#if OS_CPU_STATS
+	uint32_t run_time;		//systick counts run in the current window
+	uint32_t run_window;		//systick counts run in the last listed window
+#endif
 };
 
 /**********************
@@ -94,6 +293,10 @@ void os_system_panic(const uint8_t * msg);
 
 void os_system_start(void);
 
+port_context_t * os_isr_context(void);
+
+void os_isr_exit(void) __attribute__((naked, noinline));
+
 
 /* os_thread */
 void os_thread_create(	os_thread_t * thd,
@@ -108,17 +311,60 @@ void os_thread_createI( os_thread_t * thd,
 			uint8_t * stack, 
 			uint16_t stack_size);
 
+void os_thread_table_init(	os_thread_t * table,
+				void (* const entries[])(void),
+				uint8_t count);
+
 void os_thread_list(void);
 
+uint16_t os_thread_stack_free(os_thread_t * thd);
+
+os_thread_t * os_thread_get_list(void);
+
+void os_thread_suspend(os_thread_t * thd);
+
+void os_thread_resume(os_thread_t * thd);
+
+os_error_t os_thread_set_priority(os_thread_t * thd, os_priority_t prio);
+
+os_error_t os_thread_delete(os_thread_t * thd);
+
+void os_print_u16(uint16_t value);
+
+void os_print_u32(uint32_t value);
+
 
 /* os_delay */
 
+uint8_t os_delay_advance(hal_systick_t ticks);
+
 void os_delay_compute(void);
 
 void os_delay(hal_systick_t delay) __attribute__((naked));
 
 void os_delay_windowed(hal_systick_t * last_wake, hal_systick_t delay);
 
+os_error_t os_delay_until(hal_systick_t * next_wake, hal_systick_t period, hal_systick_t * missed);
+
+
+
+/* os_pool */
+
+void os_pool_create(os_pool_t * pool, void * buffer, uint8_t block_size, uint8_t count);
+
+void * os_pool_alloc(os_pool_t * pool);
+
+os_error_t os_pool_free(os_pool_t * pool, void * block);
+
+
+/* os_timer */
+
+void os_timer_create(os_timer_t * timer, void (*callback)(void * arg), void * arg);
+
+void os_timer_start(os_timer_t * timer, hal_systick_t delay, hal_systick_t period);
+
+void os_timer_stop(os_timer_t * timer);
+
 
 
 /* os_event */
@@ -127,13 +373,48 @@ void os_event_create(os_event_t * event, os_event_state_t state);
 
 void os_event_wait(os_event_t * event) __attribute__((naked));
 
+os_error_t os_event_wait_timeout(os_event_t * event, hal_systick_t timeout);
+
 void os_event_signal(os_event_t * event) __attribute__((naked));
 
+void os_event_signal_fromISR(os_event_t * event);
+
 
 void os_event_take(os_event_t * event);
 
 void os_event_release(os_event_t * event);
 
+
+/* os_mutex */
+
+void os_mutex_create(os_mutex_t * mutex);
+
+void os_mutex_lock(os_mutex_t * mutex);
+
+void os_mutex_unlock(os_mutex_t * mutex);
+
+
+/* os_sem */
+
+void os_sem_create(os_sem_t * sem, uint16_t count);
+
+void os_sem_wait(os_sem_t * sem);
+
+void os_sem_post(os_sem_t * sem);
+
+void os_sem_post_fromISR(os_sem_t * sem);
+
+
+/* os_queue */
+
+void os_queue_create(os_queue_t * queue, void * buffer, uint8_t item_size, uint8_t length);
+
+void os_queue_send(os_queue_t * queue, const void * item);
+
+void os_queue_receive(os_queue_t * queue, void * item);
+
+os_error_t os_queue_send_fromISR(os_queue_t * queue, const void * item);
+
 #endif /* OS_H */
 
 /* END */
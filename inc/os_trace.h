@@ -0,0 +1,91 @@
+/*  Title       : os_trace
+ *  Filename    : os_trace.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : scheduler trace ring buffer
+ */
+
+#ifndef OS_TRACE_H
+#define OS_TRACE_H
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <stdint.h>
+
+#include <hal.h>
+
+/**********************
+ *  CONSTANTS
+ **********************/
+
+/* record scheduler events, decoded on the host by tools/os_trace.py */
+#ifndef OS_TRACE
+#define OS_TRACE	0
+#endif
+
+/* records kept in ram, the oldest are overwritten */
+#ifndef OS_TRACE_LEN
+#define OS_TRACE_LEN	64
+#endif
+
+#define OS_TRACE_VERSION	2
+
+/* arg when there is no thread to report */
+#define OS_TRACE_NONE	0xFF
+
+
+/**********************
+ *  MACROS
+ **********************/
+
+#if OS_TRACE
+#define os_trace(type, arg) \
+    os_trace_recordI((type), (arg))
+#else
+#define os_trace(type, arg)
+#endif
+
+
+/**********************
+ *  TYPEDEFS
+ **********************/
+
+typedef enum os_trace_type {
+	OS_TRACE_SWITCH = 1,	//arg: id of the thread switched in
+	OS_TRACE_SIGNAL,	//arg: id of the first thread woken by an event
+	OS_TRACE_ISR_ENTER,	//arg: vector number
+	OS_TRACE_ISR_EXIT,	//arg: vector number
+	OS_TRACE_EXPIRE		//arg: id of the thread whose delay expired
+}os_trace_type_t;
+
+/**
+ * sent as is by os_trace_dump, packed to the 5 bytes of the dump format
+ * time of the record (see hal_systick_stampI), the 16 bit tick wraps
+ * after 131s, the watchdog wake-ups are recorded so that sleeping
+ * never leaves a longer gap
+ **/
+typedef struct os_trace_record {
+	uint8_t type;
+	uint8_t arg;
+	uint8_t count;		//systick timer count in the tick
+	uint16_t tick;		//low 16 bits of the systick
+}__attribute__((packed)) os_trace_record_t;
+
+
+/**********************
+ *  PROTOTYPES
+ **********************/
+
+void os_trace_recordI(uint8_t type, uint8_t arg);
+
+void os_trace_dump(void);
+
+
+#endif /* OS_TRACE_H */
+
+/* END */
@@ -24,6 +24,14 @@
  *  CONSTANTS
  **********************/
 
+//full frame: r0-r31 and sreg, saved on preemption from an interrupt
+#define PORT_FRAME_FULL		0
+//light frame: call-saved registers only, saved on a voluntary switch
+#define PORT_FRAME_LIGHT	1
+
+//registers in a light frame: r2-r17, r28, r29
+#define PORT_FRAME_LIGHT_REGS	18
+
 
 /**********************
  *  MACROS
@@ -45,6 +53,20 @@
 #define nop() \
     asm volatile ("nop"::)
 
+//interrupts are enabled right before sleeping so no wake-up is lost
+#define port_sleep() \
+    asm volatile (   \
+        "sei    \n\t" \
+        "sleep" )
+
+//critical section usable with interrupts enabled or not
+#define port_irq_save(flags) \
+    (flags) = SREG; \
+    cli()
+
+#define port_irq_restore(flags) \
+    SREG = (flags)
+
 
 
 
@@ -90,7 +112,38 @@
     asm volatile (			\
     	"in	%0, __SP_L__	\n\t"	\
     	"in	%1, __SP_H__	\n\t"	\
-    	:"=r"((ctx)->spl), "=r"((ctx)->sph))
+    	:"=r"((ctx)->spl), "=r"((ctx)->sph));	\
+    (ctx)->frame = PORT_FRAME_FULL
+
+//voluntary switch, called from C so the call-clobbered registers
+//are already dead and the return address is on the stack
+//18 registers in 37 cycles against 33 in 69 cycles for the full frame
+#define port_context_save_light(ctx)	\
+    asm volatile (			\
+    	"cli			\n\t"	\
+    	"push	r2 		\n\t"	\
+    	"push	r3 		\n\t"	\
+    	"push	r4 		\n\t"	\
+    	"push	r5 		\n\t"	\
+    	"push	r6 		\n\t"	\
+    	"push	r7 		\n\t"	\
+    	"push	r8 		\n\t"	\
+    	"push	r9 		\n\t"	\
+    	"push	r10 		\n\t"	\
+    	"push	r11 		\n\t"	\
+    	"push	r12		\n\t"	\
+    	"push	r13		\n\t"	\
+    	"push	r14		\n\t"	\
+    	"push	r15 		\n\t"	\
+    	"push	r16		\n\t"	\
+    	"push	r17 		\n\t"	\
+    	"push	r28		\n\t"	\
+    	"push	r29 		\n\t");	\
+    asm volatile (			\
+    	"in	%0, __SP_L__	\n\t"	\
+    	"in	%1, __SP_H__	\n\t"	\
+    	:"=r"((ctx)->spl), "=r"((ctx)->sph));	\
+    (ctx)->frame = PORT_FRAME_LIGHT
 
 
 #define port_context_restore(ctx)	\
@@ -100,53 +153,14 @@
 	::"r"((ctx)->spl), "r"((ctx)->sph))
 
 
-#define port_context_create(ctx)			\
-    asm volatile (  					\
-    	"out    __SP_L__, %0   \n\t"/* set spl		*/\
-	"out    __SP_H__, %1   \n\t"/* set sph		*/\
-	"push   %2             \n\t"/* set pcl		*/\
-	"push   %3             \n\t"/* set pch		*/\
-	"clr    r0             \n\t"/* 			*/\
-	"push   r0             \n\t"/*	r0		*/\
-	"in     r0, __SREG__   \n\t"/*			*/\
-	"push   r0             \n\t"/*	sreg		*/\
-	"clr    r0             \n\t"/*			*/\
-	"clr    r1             \n\t"/*			*/\
-	"push   r0             \n\t"/*	r1		*/\
-	"push   r0             \n\t"/*	r2		*/\
-	"push   r0             \n\t"/*	r3		*/\
-	"push   r0             \n\t"/*	r4		*/\
-	"push   r0             \n\t"/*	r5		*/\
-	"push   r0             \n\t"/*	r6		*/\
-	"push   r0             \n\t"/*	r7		*/\
-	"push   r0             \n\t"/*	r8		*/\
-	"push   r0             \n\t"/*	r9		*/\
-	"push   r0             \n\t"/*	r10		*/\
-	"push   r0             \n\t"/*	r11		*/\
-	"push   r0             \n\t"/*	r12		*/\
-	"push   r0             \n\t"/*	r13		*/\
-	"push   r0             \n\t"/*	r14		*/\
-	"push   r0             \n\t"/*	r15		*/\
-	"push   r0             \n\t"/*	r16		*/\
-	"push   r0             \n\t"/*	r17		*/\
-	"push   r0             \n\t"/*	r18		*/\
-	"push   r0             \n\t"/*	r19		*/\
-	"push   r0             \n\t"/*	r20		*/\
-	"push   r0             \n\t"/*	r21		*/\
-	"push   r0             \n\t"/*	r22		*/\
-	"push   r0             \n\t"/*	r23		*/\
-	"push   r0             \n\t"/*	r24		*/\
-	"push   r0             \n\t"/*	r25		*/\
-	"push   r0             \n\t"/*	r26		*/\
-	"push   r0             \n\t"/*	r26		*/\
-	"push   r0             \n\t"/*	r27		*/\
-	"push   r0             \n\t"/*	r29		*/\
-	"push   r0             \n\t"/*	r30		*/\
-	"push   r0             \n\t"/*	r31		*/\
-	::"r"((ctx)->spl), "r"((ctx)->sph), "r"((ctx)->pcl), "r"((ctx)->pch))
-
-#define port_context_return()		\
+//switch the stack to ctx and unwind whichever frame was saved there
+//interrupts must be disabled
+#define port_context_resume(ctx)	\
     asm volatile (			\
+    	"out    __SP_L__, %0   \n\t"	\
+	"out    __SP_H__, %1   \n\t"	\
+	"tst    %2             \n\t"	\
+	"brne   1f             \n\t"	\
 	"pop    r31            \n\t"    \
 	"pop    r30            \n\t"    \
 	"pop    r29            \n\t"    \
@@ -182,7 +196,28 @@
 	"out    __SREG__, r0   \n\t"	\
 	"pop    r0             \n\t"	\
 	"reti		       \n\t"	\
-	::)
+	"1:                    \n\t"	\
+	"pop    r29            \n\t"    \
+	"pop    r28            \n\t"    \
+	"pop    r17            \n\t"    \
+	"pop    r16            \n\t"    \
+	"pop    r15            \n\t"    \
+	"pop    r14            \n\t"    \
+	"pop    r13            \n\t"    \
+	"pop    r12            \n\t"    \
+	"pop    r11            \n\t"    \
+	"pop    r10            \n\t"    \
+	"pop    r9             \n\t"    \
+	"pop    r8             \n\t"    \
+	"pop    r7             \n\t"    \
+	"pop    r6             \n\t"    \
+	"pop    r5             \n\t"    \
+	"pop    r4             \n\t"    \
+	"pop    r3             \n\t"    \
+	"pop    r2             \n\t"    \
+	"clr    r1             \n\t"	\
+	"reti		       \n\t"	\
+	::"r"((ctx)->spl), "r"((ctx)->sph), "r"((ctx)->frame))
 
 
 
@@ -193,10 +228,7 @@
 typedef struct port_context {
     uint8_t spl;
     uint8_t sph;
-    void * entry;
-    uint8_t * stack_top;     
-    uint8_t pcl;
-    uint8_t pch;           
+    uint8_t frame;
 }port_context_t;
 
 
@@ -209,13 +241,18 @@ typedef struct port_context {
  *  PROTOTYPES
  **********************/
 
+//build the first frame of a thread on its stack, as if it had yielded
+//right before its entry point, so that it starts with a plain resume
 static inline void port_context_init(port_context_t* ctx, void (*entry)(void), uint8_t * stack, uint16_t stack_size) {
-	ctx->stack_top = &(stack[stack_size-1]); //get last element of stack
-	ctx->entry = (void*) entry;
-	ctx->pcl = (uint8_t) ((uint16_t) entry);
-	ctx->pch = (uint8_t) ((uint16_t) entry >> 8);
-	ctx->spl = (uint8_t) ((uint16_t) ctx->stack_top);
-	ctx->sph = (uint8_t) ((uint16_t) ctx->stack_top >> 8);
+	uint8_t * sp = &(stack[stack_size-1]); //get last element of stack
+	*sp-- = (uint8_t) ((uint16_t) entry);		//pcl
+	*sp-- = (uint8_t) ((uint16_t) entry >> 8);	//pch
+	for(uint8_t i = 0; i < PORT_FRAME_LIGHT_REGS; i++) {
+		*sp-- = 0;
+	}
+	ctx->spl = (uint8_t) ((uint16_t) sp);
+	ctx->sph = (uint8_t) ((uint16_t) sp >> 8);
+	ctx->frame = PORT_FRAME_LIGHT;
 }
 
 
@@ -0,0 +1,102 @@
+/*  Title       : prof
+ *  Filename    : prof.h
+ *  Author      : iacopo sprenger
+ *  Date        : 17.10.2026
+ *  Version     : 0.1
+ *  Description : hot path profiling with cycle histograms
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+
+
+/**********************
+ *  INCLUDES
+ **********************/
+
+#include <stdint.h>
+
+/**********************
+ *  CONSTANTS
+ **********************/
+
+/* time the instrumented sites, uses timer2 (not with HAL_SLEEP_TIMER2_ASYNC)
+ * the overflow interrupt wakes the idle thread every 256us */
+#ifndef PROF_ENABLE
+#define PROF_ENABLE	0
+#endif
+
+/* log2 histogram buckets, the last one counts all the longer runs */
+#ifndef PROF_BUCKETS
+#define PROF_BUCKETS	12
+#endif
+
+/* timer2 at clk/8 */
+#define PROF_CYCLES_PER_COUNT	8
+
+
+/**********************
+ *  MACROS
+ **********************/
+
+/**
+ * PROF_BEGIN and PROF_END enclose a site in the same block
+ * interrupts must be disabled at PROF_END (handlers and scheduler)
+ * the measure includes the few cycles of the calls
+ **/
+#if PROF_ENABLE
+#define PROF_BEGIN(id) \
+    uint16_t prof_start_##id = prof_nowI()
+
+#define PROF_END(id) \
+    prof_recordI((id), prof_start_##id)
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+#endif
+
+
+/**********************
+ *  TYPEDEFS
+ **********************/
+
+typedef enum prof_site {
+	PROF_LED_PWM,		//TIMER1_COMPA_vect
+	PROF_TWI,		//TWI_vect
+	PROF_UART_DRE,		//USART_UDRE_vect
+	PROF_SYSTICK,		//os_delay_compute
+	PROF_RESCHEDULE,	//os_system_reschedule
+	PROF_SITES
+}prof_site_t;
+
+/**
+ * durations in timer counts (PROF_CYCLES_PER_COUNT cycles)
+ * hist[0] counts runs under one count, hist[k] runs of 2^(k-1) to
+ * 2^k - 1 counts
+ **/
+typedef struct prof_stats {
+	uint16_t count;
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+	uint16_t hist[PROF_BUCKETS];
+}prof_stats_t;
+
+
+/**********************
+ *  PROTOTYPES
+ **********************/
+
+void prof_init(void);
+
+uint16_t prof_nowI(void);
+
+void prof_recordI(prof_site_t site, uint16_t start);
+
+void prof_dump(void);
+
+
+#endif /* PROF_H */
+
+/* END */
@@ -10,32 +10,41 @@
 #define CHARGER_TYPE_MASK       0xF0
 #define CHARGER_STATUS_MASK     0xE0
 
+/* worst case wait for an i2c transfer in ticks */
+#define CHARGER_I2C_TIMEOUT     10
+
 
 
 static os_event_t i2c_event;
 
 static charger_type_t charger_last_type;
-static charger_type_t charger_last_status;
+static charger_status_t charger_last_status;
 static uint8_t charger_using_hv = 0;
 
 /* this will be called from ISR */
 void i2c_done(void) {
-	os_event_signal(&i2c_event);
+	os_event_signal_fromISR(&i2c_event);
 }
 
 
-void charger_i2c_write(uint8_t reg, uint8_t data) {
+/* returns OS_TIMEOUT if the transfer did not complete (e.g. nack) */
+os_error_t charger_i2c_write(uint8_t reg, uint8_t data) {
         static uint8_t _data;
         _data = data;
         hal_i2c_reg_write_it(CHARGER_ADDR, reg, &_data, 1, i2c_done);
-        os_event_wait(&i2c_event);
+        return os_event_wait_timeout(&i2c_event, CHARGER_I2C_TIMEOUT);
 }
 
-uint8_t charger_i2c_read(uint8_t reg) {
+/* value is only written if the transfer completed */
+os_error_t charger_i2c_read(uint8_t reg, uint8_t * value) {
         static uint8_t _data;
         hal_i2c_reg_read_it(CHARGER_ADDR, reg, &_data, 1, i2c_done);
-        os_event_wait(&i2c_event);
-        return _data;
+        os_error_t err = os_event_wait_timeout(&i2c_event, CHARGER_I2C_TIMEOUT);
+        if(err != OS_SUCCESS) {
+                return err;
+        }
+        *value = _data;
+        return OS_SUCCESS;
 }
 
 
@@ -60,24 +69,38 @@ void charger_init(void) {
 }
 
 
+/* CT_UNKNOWN if the charger did not answer, the HV setting is kept */
 charger_type_t charger_get_type(void) {
-        charger_last_type = charger_i2c_read(0x11) & CHARGER_TYPE_MASK;
+        uint8_t reg;
+        if(charger_i2c_read(0x11, &reg) != OS_SUCCESS) {
+                charger_last_type = CT_UNKNOWN;
+                return charger_last_type;
+        }
+        charger_last_type = reg & CHARGER_TYPE_MASK;
 
         if(charger_last_type == CT_HV_2A && charger_using_hv == 0) {
-                /* set HV to 12.3V */
-                charger_i2c_write(0x0B, 0b00010010);
-                charger_using_hv = 1;
+                /* set HV to 12.3V, retried on the next call if it fails */
+                if(charger_i2c_write(0x0B, 0b00010010) == OS_SUCCESS) {
+                        charger_using_hv = 1;
+                }
         } else if(charger_last_type != CT_HV_2A && charger_using_hv == 1) {
                 /* disable HV to 5V */
-                charger_i2c_write(0x0B, 0b00010000);
-                charger_using_hv = 0;
+                if(charger_i2c_write(0x0B, 0b00010000) == OS_SUCCESS) {
+                        charger_using_hv = 0;
+                }
         }
 
         return charger_last_type;
 }
 
+/* CS_UNKNOWN if the charger did not answer */
 charger_status_t charger_get_status(void) {
-        charger_last_status = charger_i2c_read(0x13) & CHARGER_STATUS_MASK;
+        uint8_t reg;
+        if(charger_i2c_read(0x13, &reg) != OS_SUCCESS) {
+                charger_last_status = CS_UNKNOWN;
+                return charger_last_status;
+        }
+        charger_last_status = reg & CHARGER_STATUS_MASK;
 
         return charger_last_status;
 }
\ No newline at end of file
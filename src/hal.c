@@ -11,7 +11,10 @@
  **********************/
 
 #include <hal.h>
+#include <os_trace.h>
+#include <prof.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 /**********************
  *	CONSTANTS
@@ -24,6 +27,24 @@
 
 #define I2C_FREQUENCY 400000
 
+/* systick: 250 counts of clk/64 per tick, clk/1024 while stretched */
+#define SYSTICK_TOP		(HAL_SYSTICK_COUNTS-1)
+#define SYSTICK_CS		0b011
+#define SYSTICK_LONG_CS		0b101
+#define SYSTICK_LONG_RATIO	16
+#define SYSTICK_US_PER_COUNT	(HAL_SYSTICK_PRESCALER / (F_CPU / 1000000UL))
+#define SYSTICK_US_PER_TICK	((uint32_t) HAL_SYSTICK_COUNTS * SYSTICK_US_PER_COUNT)
+
+/* watchdog wake-up from power-down: 16ms << prescaler, in ticks */
+#define SLEEP_WDT_PRESCALERS	10
+#define SLEEP_WDT_TICKS(k)	((uint16_t) ((16000ULL << (k)) * F_CPU / \
+				(1000000ULL * HAL_SYSTICK_COUNTS * HAL_SYSTICK_PRESCALER)))
+
+/* timer2 on the 32.768kHz crystal at /128, ticks per count in 8.8 fixed point */
+#define SLEEP_T2_CS		0b101
+#define SLEEP_T2_TICKS_Q8	((uint16_t) (128ULL * 256 * F_CPU / \
+				(32768ULL * HAL_SYSTICK_COUNTS * HAL_SYSTICK_PRESCALER)))
+
 #define SPI_FREQUENCY 500000
 
 #define SPI_MIN_FREQUENCY 0
@@ -103,6 +124,17 @@
 #endif
 
 
+//timed sequence of the watchdog: the change enable and the new value
+//within 4 cycles, in one block so the compiler cannot spread the writes
+#define wdt_write(value)	\
+    asm volatile (		\
+	"sts	%0, %1	\n\t"	\
+	"sts	%0, %2	\n\t"	\
+	:: "n" (WDTCSR_ADDR),	\
+	"r" ((uint8_t) ((1<<WDCE) | (1<<WDE))),	\
+	"r" ((uint8_t) (value))	\
+	: "memory")
+
 #define i2c_wait() 	\
         while(!(TWCR & (1<<TWINT)))
 
@@ -204,7 +236,46 @@ static hal_spi_t spi;
 
 static hal_i2c_t i2c;
 
-static hal_systick_t system_tick;
+//read without masking interrupts, see hal_systick_get
+static volatile hal_systick_t system_tick;
+
+static volatile uint8_t systick_stretched;
+
+//prescaler phase: clk/64 edges since the last clk/1024 edge (mod 16)
+//when the current tick started, the prescaler is never reset after init
+static uint8_t systick_phase;
+
+//counts elapsed in the current tick when the stretch started, and
+//count of the tick at which the stretched counter was zero
+static uint8_t systick_entry;
+static int16_t systick_base;
+
+//counts the timer is behind the time after an unstretch that could not
+//write the exact count, added back by the next stretch
+static uint8_t systick_carry;
+
+static const uint16_t sleep_wdt_ticks[SLEEP_WDT_PRESCALERS] PROGMEM = {
+	SLEEP_WDT_TICKS(0), SLEEP_WDT_TICKS(1), SLEEP_WDT_TICKS(2), SLEEP_WDT_TICKS(3),
+	SLEEP_WDT_TICKS(4), SLEEP_WDT_TICKS(5), SLEEP_WDT_TICKS(6), SLEEP_WDT_TICKS(7),
+	SLEEP_WDT_TICKS(8), SLEEP_WDT_TICKS(9)
+};
+
+//SM2:0 bits of SMCR for each hal_sleep_mode_t
+static const uint8_t sleep_smcr[HAL_SLEEP_MODES] PROGMEM = {
+	0b000<<1, 0b001<<1, 0b011<<1, 0b010<<1
+};
+
+static uint8_t sleep_active;
+static hal_sleep_mode_t sleep_mode;
+static hal_systick_t sleep_start;	//systick when the sleep started
+static hal_systick_t sleep_wdt;		//programmed watchdog period in ticks
+static volatile uint8_t sleep_wdt_fired;
+static hal_systick_t sleep_residency[HAL_SLEEP_MODES];
+
+#if HAL_SLEEP_TIMER2_ASYNC
+static uint8_t sleep_t2_start;
+static uint16_t sleep_t2_frac;		//fraction of tick carried to the next sleep
+#endif
 
 
 /**********************
@@ -284,6 +355,12 @@ void hal_uart_send(uint8_t * data, uint16_t len) {
 	uart.tx_busy = 0;
 }
 
+//wait for the end of an interrupt driven transfer, hal_uart_send drops
+//its data while one is running. interrupts must be enabled
+void hal_uart_flush(void) {
+	while(*(volatile uint8_t *) &(uart.tx_busy));
+}
+
 void hal_uart_send_it(uint8_t * data, uint16_t len, void (*tx_cmplt)(void)) {
 	if(uart.tx_busy) {
 		return;
@@ -1084,11 +1161,13 @@ void hal_led_set_brightness(uint8_t channel, hal_led_brightness_t step) {
 
 
 ISR(TIMER1_COMPA_vect) {
+	PROF_BEGIN(PROF_LED_PWM);
 	for(uint8_t i = 0; i < hal_led_count; i++) {
 		if(hal_led_data[i].step == LED_HIGH) {
 			hal_gpio_set(hal_led_data[i].port, hal_led_data[i].pin);
 		}
 	}
+	PROF_END(PROF_LED_PWM);
 }
 
 ISR(TIMER1_COMPB_vect) {
@@ -1115,20 +1194,35 @@ ISR(TIMER1_OVF_vect) {
 void hal_systick_init() {
 
 	system_tick = 0;
+	systick_stretched = 0;
+	systick_phase = 0;
+	systick_carry = 0;
 
 
 	TCCR0A = 0b10; //ctc mode
 
-	OCR0A = 249; //250-1
+	OCR0A = SYSTICK_TOP; //250-1
 	//--> this gives us an interrupt freq of 1ms
 
-	//using timer0 with prescaler /8
-	//also start timer
-	TCCR0B = 0b011<<CSO;
-
 	TCNT0 = 0;
 
+	//using timer0 with prescaler /64
+	//also start timer, from a known prescaler phase
+	//(timer1 runs at clk/1 and is not affected)
+	GTCCR = (1<<PSRSYNC);
+	TCCR0B = SYSTICK_CS<<CSO;
+
 	TIMSK0 = 1<<OCIExA; //enable compare A interrupt
+
+#if HAL_SLEEP_TIMER2_ASYNC
+	//free running on the crystal, only used to wake up from power-save
+	TIMSK2 = 0;
+	ASSR = 1<<AS2;
+	TCCR2A = 0;
+	TCNT2 = 0;
+	TCCR2B = SLEEP_T2_CS;
+	while(ASSR & ((1<<TCN2UB) | (1<<TCR2BUB)));
+#endif
 }
 
 
@@ -1138,19 +1232,312 @@ void hal_systick_init() {
  **/
 
 hal_systick_t hal_systick_get(void) {
-	//guards as 32bit assignement is not atomic
-	cli();
-	hal_systick_t shadow = system_tick;
-	sei();
+	//32bit read is not atomic, read again if a tick came in between
+	hal_systick_t shadow;
+	do {
+		shadow = system_tick;
+	} while(shadow != system_tick);
+	return shadow;
+}
+
+/**
+ * 	low 16 bits of the system time, for intervals shorter than 65535
+ * 	ticks: compare with (uint16_t) (hal_systick_get16() - start)
+ **/
+uint16_t hal_systick_get16(void) {
+	uint16_t shadow;
+	do {
+		shadow = (uint16_t) system_tick;
+	} while(shadow != (uint16_t) system_tick);
 	return shadow;
 }
 
+/**
+ * 	timer counts (clk/64) elapsed since system_tick was incremented,
+ * 	also while the systick is stretched where it can exceed a tick
+ **/
+static uint16_t hal_systick_elapsed(void) {
+	uint16_t counts = TCNT0;
+	if(TIFR0 & (1<<OCF0A)) {
+		//compare match not serviced yet, the counter has wrapped
+		counts = TCNT0 + (uint16_t) OCR0A + 1;
+	}
+	if(systick_stretched) {
+		counts = counts * SYSTICK_LONG_RATIO + systick_base;
+		if((int16_t) counts < systick_entry) {
+			//before the first clk/1024 edge
+			counts = systick_entry;
+		}
+	} else {
+		counts += systick_carry;
+	}
+	return counts;
+}
+
+/**
+ * 	returns system time in microseconds with the resolution of a timer
+ * 	count, also while the systick is stretched. wraps every 71 minutes
+ **/
+uint32_t hal_timestamp_us(void) {
+	hal_systick_t tick;
+	uint8_t stretched;
+	uint16_t counts;
+	do {
+		tick = system_tick;
+		stretched = systick_stretched;
+		counts = hal_systick_elapsed();
+	} while(tick != system_tick || stretched != systick_stretched);
+	return tick * SYSTICK_US_PER_TICK + (uint32_t) counts * SYSTICK_US_PER_COUNT;
+}
+
 hal_systick_t hal_systick_getI(void) {
 	return system_tick;
 }
 
 void hal_systick_inc(void) {
 	system_tick++;
+	systick_phase = (systick_phase + SYSTICK_TOP+1) & (SYSTICK_LONG_RATIO-1);
+}
+
+/**
+ * 	returns system time in timer counts (SYSTICK_TOP+1 per tick)
+ * 	only valid with the periodic systick running
+ **/
+uint32_t hal_systick_countsI(void) {
+	uint8_t counts = TCNT0;
+	hal_systick_t tick = system_tick;
+	if(TIFR0 & (1<<OCF0A)) {
+		//compare match not serviced yet, the counter has wrapped
+		counts = TCNT0;
+		tick++;
+	}
+	return tick * (SYSTICK_TOP+1) + counts;
+}
+
+/**
+ * 	returns a timestamp for the trace: the tick in the upper 24 bits
+ * 	then the timer count, also while the systick is stretched
+ **/
+uint32_t hal_systick_stampI(void) {
+	hal_systick_t tick = system_tick;
+	uint16_t counts = hal_systick_elapsed();
+	while(counts > SYSTICK_TOP) {
+		counts -= SYSTICK_TOP+1;
+		tick++;
+	}
+	return (tick << 8) | counts;
+}
+
+/**
+ * 	program the next systick interrupt up to ticks away (at most
+ * 	HAL_SYSTICK_MAX_STRETCH) instead of every tick
+ * 	the prescaler keeps running across the switch to clk/1024, the
+ * 	first clk/1024 edge comes from systick_phase
+ * 	must be called with interrupts disabled
+ **/
+void hal_systick_stretchI(hal_systick_t ticks) {
+	if(systick_stretched || (TIFR0 & (1<<OCF0A))) {
+		//already stretched or a tick is pending
+		return;
+	}
+	if(ticks > HAL_SYSTICK_MAX_STRETCH) {
+		ticks = HAL_SYSTICK_MAX_STRETCH;
+	}
+	//switch right after a clk/64 edge, the next one is 64 cycles away
+	uint8_t start = TCNT0;
+	uint8_t offset;
+	while((offset = TCNT0) == start);
+	if(TIFR0 & (1<<OCF0A)) {
+		return;
+	}
+	TCCR0B = SYSTICK_LONG_CS<<CSO;
+	TCNT0 = 0;
+
+	//clk/64 edges until the first clk/1024 edge: 1 to 16
+	uint8_t first = SYSTICK_LONG_RATIO - ((systick_phase + offset) & (SYSTICK_LONG_RATIO-1));
+	systick_entry = offset + systick_carry;
+	systick_base = (int16_t) systick_entry + first - SYSTICK_LONG_RATIO;
+	systick_carry = 0;
+	//compare one clk/1024 edge early, the exit waits for the next one
+	int16_t counts = ((int16_t) ticks * (SYSTICK_TOP+1) - systick_base) / SYSTICK_LONG_RATIO - 1;
+	if(counts < 1) {
+		counts = 1;
+	}
+	OCR0A = counts - 1;
+	systick_stretched = 1;
+}
+
+/**
+ * 	go back to the periodic systick after a stretch
+ * 	expired is set when called from the compare interrupt
+ * 	waits for the next clk/1024 edge (up to 128us) where the prescaler
+ * 	phase is known, then the system tick is corrected and the number of
+ * 	elapsed ticks returned
+ * 	must be called with interrupts disabled
+ **/
+hal_systick_t hal_systick_unstretchI(uint8_t expired) {
+	if(!systick_stretched) {
+		return 0;
+	}
+	uint8_t start = TCNT0;
+	uint16_t counts;
+	while((counts = TCNT0) == start);
+	//switch back before the first clk/64 edge
+	TCCR0B = SYSTICK_CS<<CSO;
+	if(TIFR0 & (1<<OCF0A)) {
+		expired = 1;
+	}
+	if(expired) {
+		//counter has been cleared on compare match
+		counts += OCR0A + 1;
+	}
+	counts = counts * SYSTICK_LONG_RATIO + systick_base;
+
+	hal_systick_t ticks = counts / (SYSTICK_TOP+1);
+	uint8_t remainder = counts % (SYSTICK_TOP+1);
+	systick_carry = 0;
+	if(remainder >= SYSTICK_TOP) {
+		//writing TCNT0 blocks the next compare match, the count is
+		//carried instead
+		systick_carry = remainder - (SYSTICK_TOP - 1);
+		remainder = SYSTICK_TOP - 1;
+	}
+
+	OCR0A = SYSTICK_TOP;
+	TCNT0 = remainder;
+	TIFR0 = (1<<OCF0A); //elapsed time is accounted for
+	//on a clk/1024 edge now, so the tick started remainder edges ago
+	systick_phase = (uint8_t) -remainder & (SYSTICK_LONG_RATIO-1);
+	systick_stretched = 0;
+
+	system_tick += ticks;
+	return ticks;
+}
+
+uint8_t hal_systick_stretchedI(void) {
+	return systick_stretched;
+}
+
+
+/* hal sleep */
+
+static uint8_t hal_sleep_clk_io_busy(void) {
+	if(uart.tx_busy || uart.rx_busy || i2c.busy || spi.busy) {
+		return 1;
+	}
+	//dimmed leds are driven by the timer1 interrupts
+	for(uint8_t i = 0; i < hal_led_count; i++) {
+		if(hal_led_data[i].step == LED_LOW || hal_led_data[i].step == LED_HIGH) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * 	deepest sleep mode allowed for ticks until the next deadline
+ * 	ongoing transfers and dimmed leds need the io clock, so idle
+ **/
+hal_sleep_mode_t hal_sleep_selectI(hal_systick_t ticks) {
+	if(hal_sleep_clk_io_busy()) {
+		return HAL_SLEEP_IDLE;
+	}
+	if(ADCSRA & (1<<ADSC)) {
+		//woken by the end of the conversion, a fraction of a tick
+		if((ADCSRA & (1<<ADIE)) && HAL_SLEEP_DEEPEST >= HAL_SLEEP_ADC) {
+			return HAL_SLEEP_ADC;
+		}
+		return HAL_SLEEP_IDLE;
+	}
+#if HAL_SLEEP_TIMER2_ASYNC
+	if(ticks > (SLEEP_T2_TICKS_Q8 >> 8) && HAL_SLEEP_DEEPEST >= HAL_SLEEP_SAVE) {
+		return HAL_SLEEP_SAVE;
+	}
+#endif
+	if(ticks >= pgm_read_word(&sleep_wdt_ticks[0]) && HAL_SLEEP_DEEPEST >= HAL_SLEEP_DOWN) {
+		return HAL_SLEEP_DOWN;
+	}
+	return HAL_SLEEP_IDLE;
+}
+
+/**
+ * 	program the wake-up source of the mode, at most ticks away
+ * 	power-down sleeps for the longest watchdog period that fits
+ **/
+void hal_sleep_startI(hal_sleep_mode_t mode, hal_systick_t ticks) {
+	sleep_active = 1;
+	sleep_mode = mode;
+	sleep_start = system_tick;
+	if(mode == HAL_SLEEP_DOWN) {
+		uint8_t k = SLEEP_WDT_PRESCALERS - 1;
+		while(k > 0 && pgm_read_word(&sleep_wdt_ticks[k]) > ticks) {
+			k--;
+		}
+		sleep_wdt = pgm_read_word(&sleep_wdt_ticks[k]);
+		sleep_wdt_fired = 0;
+		uint8_t wdtcsr = (1<<WDIE) | ((k & 0b1000) ? (1<<WDP3) : 0) | (k & 0b111);
+		asm volatile("wdr");
+		wdt_write(wdtcsr);
+	}
+#if HAL_SLEEP_TIMER2_ASYNC
+	else if(mode == HAL_SLEEP_SAVE) {
+		uint32_t counts = (ticks << 8) / SLEEP_T2_TICKS_Q8;
+		if(counts > 0xFF) {
+			counts = 0xFF;
+		}
+		sleep_t2_start = TCNT2;
+		OCR2A = sleep_t2_start + (uint8_t) counts;
+		while(ASSR & (1<<OCR2AUB));
+		TIFR2 = 1<<OCF2A;
+		TIMSK2 = 1<<OCIE2A;
+	}
+#endif
+	SMCR = pgm_read_byte(&sleep_smcr[mode]);
+}
+
+/**
+ * 	end of the sleep, idempotent
+ * 	returns the ticks spent with the systick stopped, they are already
+ * 	added to the systick. A power-down ended by another interrupt than
+ * 	the watchdog cannot be measured and counts for nothing
+ **/
+hal_systick_t hal_sleep_exitI(void) {
+	if(!sleep_active) {
+		return 0;
+	}
+	sleep_active = 0;
+	SMCR = 0;
+	hal_systick_t ticks = 0;
+	if(sleep_mode == HAL_SLEEP_DOWN) {
+		wdt_write(0);
+		if(sleep_wdt_fired) {
+			ticks = sleep_wdt;
+		}
+	}
+#if HAL_SLEEP_TIMER2_ASYNC
+	else if(sleep_mode == HAL_SLEEP_SAVE) {
+		//wait for one crystal cycle before reading the counter
+		OCR2B = 0;
+		while(ASSR & (1<<OCR2BUB));
+		TIMSK2 = 0;
+		uint8_t counts = TCNT2 - sleep_t2_start;
+		uint32_t elapsed = (uint32_t) counts * SLEEP_T2_TICKS_Q8 + sleep_t2_frac;
+		ticks = elapsed >> 8;
+		sleep_t2_frac = elapsed & 0xFF;
+	}
+#endif
+	system_tick += ticks;
+	sleep_residency[sleep_mode] += system_tick - sleep_start;
+	return ticks;
+}
+
+//ticks spent in a sleep mode since boot
+hal_systick_t hal_sleep_residency(hal_sleep_mode_t mode) {
+	uint8_t sreg;
+	port_irq_save(sreg);
+	hal_systick_t shadow = sleep_residency[mode];
+	port_irq_restore(sreg);
+	return shadow;
 }
 
 
@@ -1165,6 +1552,7 @@ void hal_systick_inc(void) {
 
 
 ISR(USART_UDRE_vect) {
+	PROF_BEGIN(PROF_UART_DRE);
 	//ready to send next byte
 	if((uart.tx_data_p < uart.tx_len)) {
 		UDR0 = (uint8_t) (uart.tx_data[uart.tx_data_p++]);
@@ -1177,11 +1565,14 @@ ISR(USART_UDRE_vect) {
 		UCSR0A |= (1<<TXCx);
 		UCSR0B |= 1<<TXCIEx;
 	}
+	PROF_END(PROF_UART_DRE);
 }
 
 
 
-ISR(USART_TX_vect) {
+//USART_TX_vect, the vector is in os.c (OS_ISR)
+void hal_uart_tx_isr(void) {
+	os_trace(OS_TRACE_ISR_ENTER, USART_TX_vect_num);
 	//transmission complete
 	UCSR0A |= (1<<TXCx);
 	UCSR0B &= ~(1<<TXCIEx);
@@ -1189,9 +1580,12 @@ ISR(USART_TX_vect) {
 	if(uart.tx_cmplt) {
 		uart.tx_cmplt();
 	}
+	os_trace(OS_TRACE_ISR_EXIT, USART_TX_vect_num);
 }
 
-ISR(USART_RX_vect) {
+//USART_RX_vect, the vector is in os.c (OS_ISR)
+void hal_uart_rx_isr(void) {
+	os_trace(OS_TRACE_ISR_ENTER, USART_RX_vect_num);
 	//transmission complete
 	uart.rx_data[uart.rx_data_p++] = UDR0;
 	if(uart.rx_data_p >= uart.rx_len) {
@@ -1201,24 +1595,30 @@ ISR(USART_RX_vect) {
 			uart.rx_cmplt();
 		}
 	}
-	
+	os_trace(OS_TRACE_ISR_EXIT, USART_RX_vect_num);
 }
 
 
 /* i2c */
 
-ISR(TWI_vect) {
+//TWI_vect, the vector is in os.c (OS_ISR)
+void hal_i2c_isr(void) {
+	os_trace(OS_TRACE_ISR_ENTER, TWI_vect_num);
+	PROF_BEGIN(PROF_TWI);
 	uint8_t status = i2c_status();
 
 	if(i2c.isr_mode) {
 		i2c.isr_mode(status);
 	}
-
+	PROF_END(PROF_TWI);
+	os_trace(OS_TRACE_ISR_EXIT, TWI_vect_num);
 }
 
 /* spi */
 
-ISR(SPI_STC_vect) {
+//SPI_STC_vect, the vector is in os.c (OS_ISR)
+void hal_spi_isr(void) {
+	os_trace(OS_TRACE_ISR_ENTER, SPI_STC_vect_num);
 	if(spi.resp) {
 		spi.resp[spi.data_p++] = SPDR;
 	} else {
@@ -1238,8 +1638,27 @@ ISR(SPI_STC_vect) {
 			SPDR = 0;
 		}
 	}
-	
+	os_trace(OS_TRACE_ISR_EXIT, SPI_STC_vect_num);
 }
 
+/* sleep */
+
+//traced so that the trace has a record at least every watchdog period
+ISR(WDT_vect) {
+	os_trace(OS_TRACE_ISR_ENTER, WDT_vect_num);
+	sleep_wdt_fired = 1;
+	os_trace(OS_TRACE_ISR_EXIT, WDT_vect_num);
+}
+
+#if HAL_SLEEP_TIMER2_ASYNC
+ISR(TIMER2_COMPA_vect) {
+	//wake-up only, the time is read by hal_sleep_exitI
+	os_trace(OS_TRACE_ISR_ENTER, TIMER2_COMPA_vect_num);
+	os_trace(OS_TRACE_ISR_EXIT, TIMER2_COMPA_vect_num);
+}
+#endif
+
+
+
 /* END */
 
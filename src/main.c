@@ -14,6 +14,7 @@
 #include <os.h>
 #include <hal.h>
 #include <charger.h>
+#include <prof.h>
 
 #include <stdint.h>
 #include <stdio.h>
@@ -21,21 +22,34 @@
 #include <math.h>
 
 
-static charger_status_t status;
-static charger_type_t type;
+#define REPORT_QUEUE_LEN	2
+
+#define CONTROL_PERIOD		500
+
+typedef struct charger_report {
+	charger_type_t type;
+	charger_status_t status;
+}charger_report_t;
+
+static charger_report_t report_buffer[REPORT_QUEUE_LEN];
+static os_queue_t report_queue;
 
 
 
 void  control_thread_entry(void) {
 
+	charger_report_t report;
+
 	charger_init();
 
+	//first report one period after the start
+	hal_systick_t next_wake = hal_systick_get() + CONTROL_PERIOD;
 
 	for(;;) {
-		type = charger_get_type();
-		os_delay(500);
-		status = charger_get_status();
-		os_delay(500);
+		report.type = charger_get_type();
+		report.status = charger_get_status();
+		os_queue_send(&report_queue, &report);
+		os_delay_until(&next_wake, CONTROL_PERIOD, NULL);
 	}
 }
 
@@ -116,15 +130,14 @@ void  feedback_thread_entry(void) {
 	/* setup feedback leds */
 	led_init_rgb();
 
-	os_delay(500);
-
-	
+	charger_report_t report;
 
 	for(;;) {
+		os_queue_receive(&report_queue, &report);
 		hal_gpio_clr(GPIOB, GPIO_PIN1);
 		hal_print("Charger Type: ");
 		os_delay(50);
-		switch(type) {
+		switch(report.type) {
 		case CT_NONE:
 			hal_print_it("None (500mA)\n");
 			break;
@@ -165,7 +178,7 @@ void  feedback_thread_entry(void) {
 		os_delay(100);
 		hal_print_it("Charger Status: ");
 		os_delay(50);
-		switch(status) {
+		switch(report.status) {
 		case CS_NONE:
 			hal_print_it("None\n");
 			led_set_color(LED_OFF);
@@ -190,12 +203,30 @@ void  feedback_thread_entry(void) {
 			hal_print_it("Done!\n");
 			led_set_color(LED_GREEN);
 			break;
+		case CS_UNKNOWN:
+			hal_print_it("No answer\n");
+			led_set_color(LED_OFF);
+			break;
 		}
-		os_delay(800);
+#if OS_TRACE
+		//decoded on the host by tools/os_trace.py
+		os_trace_dump();
+#endif
+#if PROF_ENABLE
+		prof_dump();
+#endif
 	}
 }
 
 
+/* threads, by decreasing priority */
+#define APP_THREADS(X) \
+	X(feedback, 3, feedback_thread_entry, 256) \
+	X(control, 2, control_thread_entry, 256)
+
+OS_THREAD_TABLE(APP_THREADS);
+
+
 int main(void) {
 
 	/* hal led initialization */
@@ -204,34 +235,17 @@ int main(void) {
 	hal_uart_init();
 	hal_i2c_init();
 	hal_led_init();
+#if PROF_ENABLE
+	prof_init();
+#endif
 	os_system_init();
 
-
-
-
-
-
-	/* threads definitions */
-
-	static uint8_t feedback_stack[256];
-	static os_thread_t feedback_thread = {
-		.name = "feedback"
-	};
-
-	static uint8_t control_stack[256];
-	static os_thread_t control_thread = {
-		.name = "control "
-	};
-
-
-
-
+	os_queue_create(&report_queue, report_buffer, sizeof(charger_report_t), REPORT_QUEUE_LEN);
 
 
 
 	/* threads creation */
-	os_thread_createI(&feedback_thread, 3, feedback_thread_entry, feedback_stack, sizeof(feedback_stack));
-	os_thread_createI(&control_thread, 2, control_thread_entry, control_stack, sizeof(control_stack));
+	OS_THREAD_TABLE_INIT();
 
 
 
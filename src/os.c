@@ -13,14 +13,25 @@
 #include <os.h>
 #include <port.h>
 #include <hal.h>
+#include <os_trace.h>
+#include <prof.h>
 
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 /**********************
  *	CONSTANTS
  **********************/
 
-#define IDLE_STACK_SIZE	64
+/* the idle thread is interrupted while asleep: the stack holds the
+ * interrupt frame and its calls (tick with tickless exit, or a driver
+ * interrupt with a full frame, its handler and the reschedule)
+ * on top of the idle loop, os_next_deadline and the sleep selection.
+ * about 110 bytes at worst, check with os_thread_list after wake-ups
+ * from the watchdog and timer2 */
+#ifndef IDLE_STACK_SIZE
+#define IDLE_STACK_SIZE	128
+#endif
 
 
 /**********************
@@ -30,14 +41,43 @@
 #define for_each_thread(head, node) \
 	for(os_thread_t * node = head; node->next != 0; node = node->next)
 
+//give the cpu to the thread elected by the scheduler, never returns
+#define os_context_switch()						\
+	port_context_resume(&scheduler.running->context)
+
 
 /**********************
  *	TYPEDEFS
  **********************/
 
+/**
+ * ready threads are kept in one circular list per priority level,
+ * ready[prio] points to the tail of the list (tail->queue_next is the head)
+ * bit n of ready_map is set when ready[n] is not empty
+ * suspended threads are kept in a delta list sorted by wake-up time
+ **/
 typedef struct os_scheduler {
     os_thread_t * head;
     os_thread_t * running;
+    uint8_t ready_map;
+    os_thread_t * ready[OS_PRIORITY_LEVELS];
+    os_thread_t * delayed;
+    uint8_t switch_pending;		//set from interrupts, switch in os_isr_exit
+#if OS_TIMESLICE
+    uint8_t slice;			//ticks left to the running thread
+    uint8_t slice_expired;		//running thread goes behind its level
+#endif
+#if OS_CPU_STATS
+    uint32_t switch_time;		//systick counts at the last switch
+    uint32_t window_start;		//systick counts at the last thread list
+    uint32_t window;			//length of the last listed window
+#endif
+#if OS_TIMERS
+    os_timer_t * timers;		//armed timers, delta list
+    os_timer_t * timer_pending;		//expired timers in expiry order
+    os_timer_t ** timer_pending_tail;
+    os_thread_t * timer_waiting;	//service thread when idle
+#endif
 }os_scheduler_t;
 
 
@@ -55,6 +95,28 @@ static os_thread_t idle_thread = {
 
 static uint8_t idle_stack[IDLE_STACK_SIZE];
 
+#if OS_TRACE
+static uint8_t thread_ids; //last id given, idle is 0
+#endif
+
+#if OS_TIMERS
+static os_thread_t timer_thread = {
+	.name="timers  "
+};
+
+static uint8_t timer_stack[OS_TIMER_STACK_SIZE];
+#endif
+
+//index of the most significant bit set in a nibble
+static const uint8_t os_prio_msb[16] PROGMEM = {
+	0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3
+};
+
+//avoid variable shifts, which are loops on avr
+static const uint8_t os_prio_bit[OS_PRIORITY_LEVELS] PROGMEM = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+};
+
 
 /**********************
  *	PROTOTYPES
@@ -68,8 +130,85 @@ void os_scheduler_add_threadI(	os_scheduler_t * sch,
 
 void os_thread_print(os_thread_t * thd);
 
+void os_thread_stack_paint(os_thread_t * thd, uint8_t * stack, uint16_t stack_size);
+
+
+void os_cpu_account(void);
+
+void os_cpu_window(void);
+
+uint8_t os_cpu_percent(uint32_t time);
+
 os_thread_t * os_scheduler_get_ready(os_scheduler_t * sch);
 
+void os_scheduler_remove_threadI(	os_scheduler_t * sch,
+					os_thread_t * thd);
+
+void os_scheduler_ready_push(	os_scheduler_t * sch,
+				os_thread_t * thd);
+
+void os_scheduler_ready_push_head(	os_scheduler_t * sch,
+					os_thread_t * thd);
+
+uint8_t os_scheduler_preempt(os_scheduler_t * sch);
+
+void os_scheduler_ready_remove(	os_scheduler_t * sch,
+				os_thread_t * thd);
+
+void os_scheduler_reprioritize(	os_scheduler_t * sch,
+				os_thread_t * thd,
+				os_priority_t prio);
+
+void os_system_switch(void) __attribute__((naked, noinline));
+
+void os_delay_insert(os_thread_t * thd, hal_systick_t delay);
+
+void os_delay_remove(os_thread_t * thd);
+
+void os_wait_insert(os_thread_t ** list, os_thread_t * thd);
+
+void os_wait_remove(os_thread_t ** list, os_thread_t * thd);
+
+void os_wait_wake(os_thread_t * thd);
+
+os_thread_t * os_wait_wake_one(os_thread_t ** list);
+
+void os_wait_block(os_thread_t ** list);
+
+void os_copy(uint8_t * dst, const uint8_t * src, uint8_t size);
+
+os_error_t os_queue_putI(os_queue_t * queue, const void * item);
+
+os_error_t os_queue_getI(os_queue_t * queue, void * item);
+
+void os_event_wake_all(os_event_t * event);
+
+hal_systick_t os_next_deadline(void);
+
+void os_sleep_exit(void);
+
+void os_sleep_account(void);
+
+void os_tickless_enter(hal_systick_t ticks);
+
+uint8_t os_tickless_exit(uint8_t expired);
+
+void os_timer_insert(os_timer_t * timer, hal_systick_t delay);
+
+void os_timer_remove(os_timer_t * timer);
+
+uint8_t os_timer_advance(hal_systick_t ticks);
+
+void os_timer_service(void);
+
+void os_mutex_inherit(os_mutex_t * mutex, os_priority_t prio);
+
+os_priority_t os_mutex_inherited(os_thread_t * owner);
+
+void os_mutex_recompute(os_thread_t * owner);
+
+void os_isr_pend(void);
+
 /**********************
  *	DECLARATIONS
  **********************/
@@ -83,14 +222,32 @@ void os_thread_create(	os_thread_t * thd,
 			uint16_t stack_size) {
 	cli();
 
+	if(prio >= OS_PRIORITY_LEVELS) {
+		os_system_panic("bad prio");
+	}
+
 	thd->priority = prio;
+	thd->base_priority = prio;
 	thd->state = OS_DISABLED;
-	thd->existing = 0;
 	thd->next = NULL;
+	thd->wait_list = NULL;
+	thd->waiting_mutex = NULL;
+	thd->mutex_held = 0;
+	thd->suspend = 0;
+	thd->timed = 0;
+#if OS_TRACE
+	thd->id = ++thread_ids;
+#endif
+#if OS_CPU_STATS
+	thd->run_time = 0;
+	thd->run_window = 0;
+#endif
+	os_thread_stack_paint(thd, stack, stack_size);
 	port_context_init(&(thd->context), entry, stack, stack_size);
 	os_scheduler_add_thread(&scheduler, thd);
 
 	thd->state = OS_READY; //start thread
+	os_scheduler_ready_push(&scheduler, thd);
 
 
 	sei();
@@ -102,25 +259,281 @@ void os_thread_createI(	os_thread_t * thd,
 			uint8_t * stack, 
 			uint16_t stack_size) {
 
+	if(prio >= OS_PRIORITY_LEVELS) {
+		os_system_panic("bad prio");
+	}
+
 	thd->priority = prio;
+	thd->base_priority = prio;
 	thd->state = OS_DISABLED;
-	thd->existing = 0;
 	thd->next = NULL;
+	thd->wait_list = NULL;
+	thd->waiting_mutex = NULL;
+	thd->mutex_held = 0;
+	thd->suspend = 0;
+	thd->timed = 0;
+#if OS_TRACE
+	thd->id = ++thread_ids;
+#endif
+#if OS_CPU_STATS
+	thd->run_time = 0;
+	thd->run_window = 0;
+#endif
+	os_thread_stack_paint(thd, stack, stack_size);
 	port_context_init(&(thd->context), entry, stack, stack_size);
 	os_scheduler_add_threadI(&scheduler, thd);
 
 	thd->state = OS_READY; //start thread
+	os_scheduler_ready_push(&scheduler, thd);
 }
 
 
+/**
+ *  Start the threads of a static table (see OS_THREAD_TABLE)
+ *  the objects are already filled and chained in priority order,
+ *  only the stacks are prepared and the chain linked before idle
+ *  must be called right after os_system_init
+ **/
+void os_thread_table_init(	os_thread_t * table,
+				void (* const entries[])(void),
+				uint8_t count) {
+	if(count == 0) {
+		return;
+	}
+	for(uint8_t i = 0; i < count; i++) {
+		os_thread_t * thd = &(table[i]);
+		if(thd->priority >= OS_PRIORITY_LEVELS || thd->priority == 0 ||
+				(i > 0 && thd->priority > table[i-1].priority)) {
+			os_system_panic("thread table");
+		}
+#if OS_TRACE
+		thd->id = ++thread_ids;
+#endif
+		os_thread_stack_paint(thd, thd->stack, thd->stack_size);
+		port_context_init(&(thd->context), entries[i], thd->stack, thd->stack_size);
+		os_scheduler_ready_push(&scheduler, thd);
+	}
+
+	//only the system threads are in the list, idle last
+	os_thread_t ** node = &(scheduler.head);
+	while((*node)->priority >= table[0].priority) {
+		node = &((*node)->next);
+	}
+	table[count-1].next = (*node);
+	(*node) = &(table[0]);
+}
+
 void os_thread_list(void) {
+#if OS_CPU_STATS
+	os_cpu_window();
+#endif
 	hal_print("threads list\n\r");
 	os_thread_t * node;
 	for( node = scheduler.head; node != NULL; node = node->next) {
 		os_thread_print(node);
 	}	
+#if OS_CPU_STATS
+	//interrupts are charged to the thread they preempted
+	hal_print("idle ");
+	os_print_u16(os_cpu_percent(idle_thread.run_window));
+	hal_print("% load ");
+	os_print_u16(100 - os_cpu_percent(idle_thread.run_window));
+	hal_print("%\n\r");
+#endif
+	//ticks spent in each sleep mode since boot
+	hal_print("sleep idle ");
+	os_print_u32(hal_sleep_residency(HAL_SLEEP_IDLE));
+	hal_print(" adc ");
+	os_print_u32(hal_sleep_residency(HAL_SLEEP_ADC));
+	hal_print(" save ");
+	os_print_u32(hal_sleep_residency(HAL_SLEEP_SAVE));
+	hal_print(" down ");
+	os_print_u32(hal_sleep_residency(HAL_SLEEP_DOWN));
+	hal_print("\n\r");
+}
+
+
+//all the threads by decreasing priority, linked through next
+os_thread_t * os_thread_get_list(void) {
+	return scheduler.head;
+}
+
+/**
+ *  Park a thread until os_thread_resume
+ *  a ready or running thread is parked at once, a blocked thread
+ *  when its delay or wait ends
+ **/
+void os_thread_suspend(os_thread_t * thd) {
+	if(thd == &idle_thread) {
+		os_system_panic("idle suspend");
+	}
+	cli();
+	thd->suspend = 1;
+	if(thd->state == OS_READY) {
+		os_scheduler_ready_remove(&scheduler, thd);
+		thd->state = OS_DISABLED;
+	} else if(thd == scheduler.running) {
+		thd->state = OS_DISABLED;
+		os_system_switch();
+		return;
+	}
+	sei();
+}
+
+void os_thread_resume(os_thread_t * thd) {
+	cli();
+	if(!thd->suspend) {
+		sei();
+		return;
+	}
+	thd->suspend = 0;
+	if(thd->state == OS_DISABLED) {
+		thd->state = OS_READY;
+		os_scheduler_ready_push(&scheduler, thd);
+		if(os_scheduler_preempt(&scheduler)) {
+			scheduler.running->state = OS_READY;
+			os_system_switch();
+			return;
+		}
+	}
+	sei();
+}
+
+/**
+ *  Change the base priority of a thread, 1 to OS_PRIORITY_LEVELS-1
+ *  an inherited priority is kept until the thread releases its mutexes
+ *  returns OS_ERROR for an invalid priority or the idle thread
+ **/
+os_error_t os_thread_set_priority(os_thread_t * thd, os_priority_t prio) {
+	if(prio >= OS_PRIORITY_LEVELS || prio == 0 || thd == &idle_thread) {
+		return OS_ERROR;
+	}
+	cli();
+	thd->base_priority = prio;
+#if OS_MUTEX_INHERIT
+	if(thd->mutex_held) {
+		//a lowered base does not drop what the waiters still inherit
+		os_priority_t inherited = os_mutex_inherited(thd);
+		if(inherited > prio) {
+			prio = inherited;
+		}
+	}
+#else
+	if(thd->mutex_held && prio < thd->priority) {
+		prio = thd->priority;
+	}
+#endif
+	if(prio != thd->priority) {
+		os_scheduler_reprioritize(&scheduler, thd, prio);
+#if OS_MUTEX_INHERIT
+		//raised or lowered, what the owner inherits follows
+		if(thd->waiting_mutex != NULL) {
+			os_mutex_recompute(thd->waiting_mutex->owner);
+		}
+#endif
+	}
+	//keep the list of all threads sorted
+	os_scheduler_remove_threadI(&scheduler, thd);
+	os_scheduler_add_threadI(&scheduler, thd);
+
+	if(os_scheduler_preempt(&scheduler)) {
+		scheduler.running->state = OS_READY;
+		os_system_switch();
+		return OS_SUCCESS;
+	}
+	sei();
+	return OS_SUCCESS;
+}
+
+/**
+ *  Remove a thread from the system, its stack and object can be reused
+ *  a thread holding a mutex cannot be deleted (OS_BUSY)
+ *  deleting the running thread does not return
+ **/
+os_error_t os_thread_delete(os_thread_t * thd) {
+	if(thd == &idle_thread) {
+		os_system_panic("idle delete");
+	}
+	cli();
+	if(thd->mutex_held) {
+		sei();
+		return OS_BUSY;
+	}
+	switch(thd->state) {
+		case OS_READY:
+			os_scheduler_ready_remove(&scheduler, thd);
+			break;
+		case OS_SUSPENDED:
+			os_delay_remove(thd);
+			break;
+		case OS_WAITING:
+			os_wait_remove(thd->wait_list, thd);
+			if(thd->timed) {
+				os_delay_remove(thd);
+				thd->timed = 0;
+			}
+#if OS_MUTEX_INHERIT
+			if(thd->waiting_mutex != NULL) {
+				//the owner no longer inherits from the deleted thread
+				os_mutex_t * mutex = thd->waiting_mutex;
+				thd->waiting_mutex = NULL;
+				os_mutex_recompute(mutex->owner);
+			}
+#endif
+			thd->waiting_mutex = NULL;
+			break;
+		default:
+			break;
+	}
+	os_scheduler_remove_threadI(&scheduler, thd);
+	thd->suspend = 0;
+	thd->state = OS_DISABLED;
+	if(thd == scheduler.running) {
+		os_system_switch();
+	}
+	sei();
+	return OS_SUCCESS;
+}
+
+//fill the stack with a known pattern to find its high water mark later
+void os_thread_stack_paint(os_thread_t * thd, uint8_t * stack, uint16_t stack_size) {
+	thd->stack = stack;
+	thd->stack_size = stack_size;
+	for(uint16_t i = 0; i < stack_size; i++) {
+		stack[i] = OS_STACK_PATTERN;
+	}
+}
+
+//returns the number of stack bytes never used by the thread
+//the stack grows down, so untouched bytes are at the bottom
+uint16_t os_thread_stack_free(os_thread_t * thd) {
+	uint16_t free = 0;
+	while(free < thd->stack_size && thd->stack[free] == OS_STACK_PATTERN) {
+		free++;
+	}
+	return free;
+}
+
+//digits from the end of the buffer, sent in one hal_uart_send
+void os_print_u16(uint16_t value) {
+	uint8_t buffer[5];
+	uint8_t i = sizeof(buffer);
+	do {
+		buffer[--i] = '0' + (value % 10);
+		value /= 10;
+	} while(value);
+	hal_uart_send(&(buffer[i]), sizeof(buffer) - i);
 }
 
+void os_print_u32(uint32_t value) {
+	uint8_t buffer[10];
+	uint8_t i = sizeof(buffer);
+	do {
+		buffer[--i] = '0' + (value % 10);
+		value /= 10;
+	} while(value);
+	hal_uart_send(&(buffer[i]), sizeof(buffer) - i);
+}
 
 void os_thread_print(os_thread_t * thd) {
 	hal_print(thd->name);
@@ -145,12 +558,69 @@ void os_thread_print(os_thread_t * thd) {
 			break;
 	}
 
+	//peak stack usage / stack size, free bytes
+	uint16_t free = os_thread_stack_free(thd);
+	hal_uart_send_char(' ');
+	os_print_u16(thd->stack_size - free);
+	hal_uart_send_char('/');
+	os_print_u16(thd->stack_size);
+	hal_uart_send_char(' ');
+	os_print_u16(free);
+
+#if OS_CPU_STATS
+	//share of the cpu since the previous list
+	hal_uart_send_char(' ');
+	os_print_u16(os_cpu_percent(thd->run_window));
+	hal_uart_send_char('%');
+#endif
+
 	hal_uart_send_char('\n');
 	hal_uart_send_char('\r');
 }
 
 
 
+#if OS_CPU_STATS
+
+//charge the time since the last switch to the running thread
+//interrupts must be disabled
+void os_cpu_account(void) {
+	uint32_t now = hal_systick_countsI();
+	scheduler.running->run_time += now - scheduler.switch_time;
+	scheduler.switch_time = now;
+}
+
+//close the current accounting window, its figures are kept in run_window
+void os_cpu_window(void) {
+	uint8_t sreg;
+	port_irq_save(sreg);
+	os_cpu_account();
+	scheduler.window = scheduler.switch_time - scheduler.window_start;
+	scheduler.window_start = scheduler.switch_time;
+	for(os_thread_t * node = scheduler.head; node != NULL; node = node->next) {
+		node->run_window = node->run_time;
+		node->run_time = 0;
+	}
+	port_irq_restore(sreg);
+}
+
+uint8_t os_cpu_percent(uint32_t time) {
+	uint32_t window = scheduler.window;
+	if(window == 0) {
+		return 0;
+	}
+	//keep time * 100 in 32 bits for long windows
+	while(window > 0xFFFFFF) {
+		window >>= 1;
+		time >>= 1;
+	}
+	return (time * 100 + window / 2) / window;
+}
+
+#endif
+
+
+
 /* os_scheduler */
 
 /**
@@ -186,19 +656,127 @@ void os_scheduler_add_threadI(	os_scheduler_t * sch,
 	os_system_panic("no idle thread");
 }
 
-//returns thread with highest priority that is ready.
+void os_scheduler_remove_threadI(	os_scheduler_t * sch,
+					os_thread_t * thd) {
+	os_thread_t ** node;
+	for( node = &(sch->head); (*node) != NULL; node = &((*node)->next)) {
+		if((*node) == thd) {
+			(*node) = thd->next;
+			thd->next = NULL;
+			return;
+		}
+	}
+}
+
+/**
+ *  Append thread at the tail of the ready list of its priority
+ *  a suspended thread is parked instead
+ **/
+void os_scheduler_ready_push(	os_scheduler_t * sch,
+				os_thread_t * thd) {
+	if(thd->suspend) {
+		thd->state = OS_DISABLED;
+		return;
+	}
+	os_thread_t ** tail = &(sch->ready[thd->priority]);
+	if((*tail) == NULL) {
+		thd->queue_next = thd;
+		sch->ready_map |= pgm_read_byte(&os_prio_bit[thd->priority]);
+	} else {
+		thd->queue_next = (*tail)->queue_next;
+		(*tail)->queue_next = thd;
+	}
+	(*tail) = thd;
+}
+
+/**
+ *  Insert thread at the head of the ready list of its priority
+ *  used for preempted threads so they keep their turn
+ **/
+void os_scheduler_ready_push_head(	os_scheduler_t * sch,
+					os_thread_t * thd) {
+	os_thread_t ** tail = &(sch->ready[thd->priority]);
+	if((*tail) == NULL) {
+		thd->queue_next = thd;
+		sch->ready_map |= pgm_read_byte(&os_prio_bit[thd->priority]);
+		(*tail) = thd;
+	} else {
+		thd->queue_next = (*tail)->queue_next;
+		(*tail)->queue_next = thd;
+	}
+}
+
+//removes and returns thread with highest priority that is ready.
+//constant time: bitmap lookup then pop from the head of the level
 os_thread_t * os_scheduler_get_ready(os_scheduler_t * sch) {
-	os_thread_t * node;
-	for( node = sch->head; node != NULL; node = node->next) {
-		if(node->state == OS_READY) {
-			return node;
+	uint8_t map = sch->ready_map;
+	uint8_t prio;
+	if(map == 0) {
+		//this should never happen as idle is always ready
+		os_system_panic("idle thread not ready!");
+		return NULL;
+	}
+	if(map & 0xF0) {
+		prio = 4 + pgm_read_byte(&os_prio_msb[map >> 4]);
+	} else {
+		prio = pgm_read_byte(&os_prio_msb[map]);
+	}
+	os_thread_t * tail = sch->ready[prio];
+	os_thread_t * head = tail->queue_next;
+	if(head == tail) {
+		sch->ready[prio] = NULL;
+		sch->ready_map &= ~pgm_read_byte(&os_prio_bit[prio]);
+	} else {
+		tail->queue_next = head->queue_next;
+	}
+	return head;
+}
+
+//remove a ready thread from the ready list of its priority
+void os_scheduler_ready_remove(	os_scheduler_t * sch,
+				os_thread_t * thd) {
+	os_thread_t * tail = sch->ready[thd->priority];
+	os_thread_t * prev = tail;
+	while(prev->queue_next != thd) {
+		prev = prev->queue_next;
+	}
+	if(prev == thd) {
+		//thread was alone in its level
+		sch->ready[thd->priority] = NULL;
+		sch->ready_map &= ~pgm_read_byte(&os_prio_bit[thd->priority]);
+	} else {
+		prev->queue_next = thd->queue_next;
+		if(tail == thd) {
+			sch->ready[thd->priority] = prev;
 		}
 	}
-	//this should return the idle thread
-	os_system_panic("idle thread not ready!");
-	return NULL;
 }
 
+//change the effective priority of a thread, keeping the queue it is in sorted
+void os_scheduler_reprioritize(	os_scheduler_t * sch,
+				os_thread_t * thd,
+				os_priority_t prio) {
+	if(thd->state == OS_READY) {
+		os_scheduler_ready_remove(sch, thd);
+		thd->priority = prio;
+		os_scheduler_ready_push(sch, thd);
+	} else if(thd->state == OS_WAITING) {
+		//os_wait_remove clears wait_list
+		os_thread_t ** list = thd->wait_list;
+		os_wait_remove(list, thd);
+		thd->priority = prio;
+		os_wait_insert(list, thd);
+	} else {
+		thd->priority = prio;
+	}
+}
+
+//returns 1 if a ready thread has a higher priority than the running one
+uint8_t os_scheduler_preempt(os_scheduler_t * sch) {
+	uint8_t bit = pgm_read_byte(&os_prio_bit[sch->running->priority]);
+	//any bit above the running priority
+	return (sch->ready_map & ~(bit | (bit - 1))) ? 1 : 0;
+}
 
 
 
@@ -211,6 +789,32 @@ void os_system_idle(void) {
 		//should enter idle
 		//hal_print("idle\n\r");
 		//hal_gpio_tgl(GPIOD, GPIO_PIN4);
+		cli();
+		//woken up without leaving idle (watchdog, adc, led pwm)
+		os_sleep_account();
+		if(os_scheduler_preempt(&scheduler)) {
+			//a thread was made ready from an interrupt, the reschedule
+			//ends the stretch
+			idle_thread.state = OS_READY;
+			os_system_switch();
+			continue;
+		}
+#if OS_TICKLESS_IDLE
+		if(hal_systick_stretchedI()) {
+			//the stretched compare has not fired, keep sleeping on it
+			hal_sleep_startI(HAL_SLEEP_IDLE, 0);
+			hal_sleep_enter();
+			continue;
+		}
+#endif
+		hal_systick_t deadline = os_next_deadline();
+		hal_sleep_mode_t mode = hal_sleep_selectI(deadline);
+#if OS_TICKLESS_IDLE
+		if(mode == HAL_SLEEP_IDLE) {
+			os_tickless_enter(deadline);
+		}
+#endif
+		hal_sleep_startI(mode, deadline);
 		hal_sleep_enter();
 	}
 }
@@ -220,10 +824,19 @@ void os_system_init(void) {
 	//setup idle thread
 
 	idle_thread.priority = 0;
+	idle_thread.base_priority = 0;
 	idle_thread.next = NULL;
 	idle_thread.state = OS_READY;
-	idle_thread.existing = 0;
+#if OS_TRACE
+	idle_thread.id = 0;
+	thread_ids = 0;
+#endif
+#if OS_CPU_STATS
+	idle_thread.run_time = 0;
+	idle_thread.run_window = 0;
+#endif
 
+	os_thread_stack_paint(&idle_thread, idle_stack, IDLE_STACK_SIZE);
 	port_context_init(&(idle_thread.context), os_system_idle, idle_stack, IDLE_STACK_SIZE);
 
 
@@ -233,6 +846,22 @@ void os_system_init(void) {
 	scheduler.head = &idle_thread;
 	scheduler.running = &idle_thread;
 
+	scheduler.ready_map = 0;
+	for(uint8_t i = 0; i < OS_PRIORITY_LEVELS; i++) {
+		scheduler.ready[i] = NULL;
+	}
+	os_scheduler_ready_push(&scheduler, &idle_thread);
+
+	scheduler.delayed = NULL;
+	scheduler.switch_pending = 0;
+
+#if OS_TIMERS
+	scheduler.timers = NULL;
+	scheduler.timer_pending = NULL;
+	scheduler.timer_pending_tail = &(scheduler.timer_pending);
+	scheduler.timer_waiting = NULL;
+	os_thread_createI(&timer_thread, OS_TIMER_PRIORITY, os_timer_service, timer_stack, OS_TIMER_STACK_SIZE);
+#endif
 }
 
 //give control to scheduler
@@ -245,7 +874,6 @@ void os_system_start(void) {
 
 
 	scheduler.running->state = OS_RUNNING;
-	scheduler.running->existing = 1;
 
 	//hal_print("running thread: ");
 	//os_thread_print(scheduler.running);
@@ -253,8 +881,16 @@ void os_system_start(void) {
 	hal_print("first state:\n\r");
 	os_thread_list();
 #endif
-	port_context_create(&(scheduler.running->context));
-	port_context_return();
+	cli();
+#if OS_TIMESLICE
+	scheduler.slice = OS_TIMESLICE;
+	scheduler.slice_expired = 0;
+#endif
+#if OS_CPU_STATS
+	scheduler.switch_time = hal_systick_countsI();
+	scheduler.window_start = scheduler.switch_time;
+#endif
+	os_context_switch();
 }
 
 void os_system_panic(const uint8_t * msg) {
@@ -268,14 +904,43 @@ void os_system_panic(const uint8_t * msg) {
 }
 
 //reschedule system assuming no threads are running
+//a running thread marked as ready was preempted and goes back in front of its level
 void os_system_reschedule(void) {
 #if DEBUG == VERBOSE
 	hal_print("reschedule requested\n\r");
 	os_thread_list();
 #endif
+	PROF_BEGIN(PROF_RESCHEDULE);
+	//leaving idle early (woken by another interrupt)
+	os_sleep_exit();
+#if OS_CPU_STATS
+	os_cpu_account();
+#endif
+	os_thread_t * prev = scheduler.running;
+	if(prev->state == OS_READY) {
+#if OS_TIMESLICE
+		if(scheduler.slice_expired) {
+			os_scheduler_ready_push(&scheduler, prev);
+		} else
+#endif
+		os_scheduler_ready_push_head(&scheduler, prev);
+	}
 	scheduler.running = os_scheduler_get_ready(&scheduler);
 
 	scheduler.running->state = OS_RUNNING;
+	scheduler.switch_pending = 0;
+#if OS_TIMESLICE
+	scheduler.slice_expired = 0;
+	if(scheduler.running != prev) {
+		scheduler.slice = OS_TIMESLICE;
+	}
+#endif
+#if OS_TRACE
+	if(scheduler.running != prev) {
+		os_trace(OS_TRACE_SWITCH, scheduler.running->id);
+	}
+#endif
+	PROF_END(PROF_RESCHEDULE);
 
 #if DEBUG == VERBOSE
 	hal_print("new states \n\r");
@@ -285,39 +950,159 @@ void os_system_reschedule(void) {
 
 
 
+//a thread made ready from an interrupt preempts the running one
+void os_isr_pend(void) {
+	if(os_scheduler_preempt(&scheduler)) {
+		scheduler.switch_pending = 1;
+	}
+}
+
+//where OS_ISR saves the frame of the interrupted thread
+port_context_t * os_isr_context(void) {
+	return &(scheduler.running->context);
+}
+
+/**
+ *  End of OS_ISR, never returns: switches once to the thread made ready
+ *  by the _fromISR calls, or else resumes the interrupted thread. The
+ *  full frame saved on entry is unwound by the resume and its reti
+ **/
+void os_isr_exit(void) {
+	if(scheduler.switch_pending) {
+		scheduler.running->state = OS_READY;
+		os_system_reschedule();
+	}
+	os_context_switch();
+}
+
+//voluntary context switch, the caller has already updated the state
+//of the running thread with interrupts disabled
+void os_system_switch(void) {
+	port_context_save_light(&(scheduler.running->context));
+
+	os_system_reschedule();
+
+	os_context_switch();
+}
+
+
+
 /* os_delay */
 
-//compute new delay time and set task to ready if timeout
+/**
+ *  Insert thread in the delta list of suspended threads
+ *  each node stores its delay relative to the previous one
+ **/
+void os_delay_insert(os_thread_t * thd, hal_systick_t delay) {
+	os_thread_t ** node;
+	if(delay == 0) {
+		delay = 1; //wait at least until the next tick
+	}
+	for( node = &(scheduler.delayed); (*node) != NULL; node = &((*node)->delay_next)) {
+		if(delay < (*node)->suspended_timer) {
+			(*node)->suspended_timer -= delay;
+			break;
+		}
+		delay -= (*node)->suspended_timer;
+	}
+	thd->suspended_timer = delay;
+	thd->delay_next = (*node);
+	(*node) = thd;
+}
+
+//remove thread from the delta list, its remaining delay goes to the next node
+void os_delay_remove(os_thread_t * thd) {
+	os_thread_t ** node;
+	for( node = &(scheduler.delayed); (*node) != NULL; node = &((*node)->delay_next)) {
+		if((*node) == thd) {
+			(*node) = thd->delay_next;
+			if(thd->delay_next != NULL) {
+				thd->delay_next->suspended_timer += thd->suspended_timer;
+			}
+			break;
+		}
+	}
+}
+
+//advance the delta list by the elapsed ticks and set tasks to ready if timeout
+//all threads expiring in this interval are woken in one pass
+//returns 1 if a thread was woken up
+uint8_t os_delay_advance(hal_systick_t ticks) {
+	uint8_t woken = 0;
+#if OS_TIMERS
+	woken = os_timer_advance(ticks);
+#endif
+	os_thread_t * node = scheduler.delayed;
+	if(node == NULL || node->suspended_timer > ticks) {
+		if(node != NULL) {
+			node->suspended_timer -= ticks;
+		}
+		return woken;
+	}
+	do {
+		ticks -= node->suspended_timer;
+		os_trace(OS_TRACE_EXPIRE, node->id);
+		if(node->state == OS_WAITING) {
+			//timeout expired before the wait ended
+			os_wait_remove(node->wait_list, node);
+			node->wait_status = OS_TIMEOUT;
+			node->timed = 0;
+		}
+		node->state = OS_READY;
+		os_scheduler_ready_push(&scheduler, node);
+		node = node->delay_next;
+	} while(node != NULL && node->suspended_timer <= ticks);
+	if(node != NULL) {
+		node->suspended_timer -= ticks;
+	}
+	scheduler.delayed = node;
+	return 1;
+}
+
+//compute new delay time on each systick interrupt
+//only the head of the delta list is touched
 void os_delay_compute(void){
-	os_thread_t * node;
-	for( node = scheduler.head; node != NULL; node = node->next) {
-		if(node->state == OS_SUSPENDED) {
-			node->suspended_timer--; //remove 1ms from suspended timer
-			if(node->suspended_timer == 0) {
-				node->state = OS_READY;
-				scheduler.running->state = OS_READY;
-				os_system_reschedule();
+	PROF_BEGIN(PROF_SYSTICK);
+#if OS_TICKLESS_IDLE
+	if(hal_systick_stretchedI()) {
+		os_tickless_exit(1);
+	} else
+#endif
+	{
+		hal_systick_inc();
+		os_delay_advance(1);
+#if OS_TIMESLICE
+		//rotate among the ready threads of the same level
+		if(--scheduler.slice == 0) {
+			scheduler.slice = OS_TIMESLICE;
+			if(scheduler.ready[scheduler.running->priority] != NULL) {
+				scheduler.slice_expired = 1;
 			}
 		}
+#endif
+	}
+	//also picks up threads made ready from interrupts
+	if(os_scheduler_preempt(&scheduler)
+#if OS_TIMESLICE
+			|| scheduler.slice_expired
+#endif
+			) {
+		scheduler.running->state = OS_READY;
+		os_system_reschedule();
 	}
+	PROF_END(PROF_SYSTICK);
 }
 
 void os_delay(hal_systick_t delay) {
-	port_context_save(&(scheduler.running->context));
+	port_context_save_light(&(scheduler.running->context));
 	scheduler.running->state = OS_SUSPENDED;
-	scheduler.running->suspended_timer = delay;
+	os_delay_insert(scheduler.running, delay);
 	os_system_reschedule();
 #if DEBUG == VERBOSE
 	hal_print("resched for delay: \n\r");
 	os_thread_list();
 #endif
-	if(!(scheduler.running->existing)) {
-		scheduler.running->existing = 1;
-		port_context_create(&scheduler.running->context);
-	} else {
-		port_context_restore(&scheduler.running->context);
-	}
-	port_context_return();
+	os_context_switch();
 }
 
 void os_delay_windowed(hal_systick_t * last_wake, hal_systick_t delay) {
@@ -330,71 +1115,384 @@ void os_delay_windowed(hal_systick_t * last_wake, hal_systick_t delay) {
 	*last_wake = hal_systick_get();
 }
 
+/**
+ *  Sleep until the tick *next_wake, which is then advanced by period
+ *  the deadlines follow exact multiples of period from the first one
+ *  if the deadline has passed the thread does not sleep, whole periods
+ *  already elapsed are skipped and counted in *missed (can be NULL)
+ *  returns OS_ERROR for a period of 0, OS_TIMEOUT if deadlines were missed
+ **/
+os_error_t os_delay_until(hal_systick_t * next_wake, hal_systick_t period, hal_systick_t * missed) {
+	if(period == 0) {
+		return OS_ERROR;
+	}
+	cli();
+	hal_systick_t wake = *next_wake;
+	hal_systick_t late = hal_systick_getI() - wake;
+	if((int32_t) late < 0) {
+		*next_wake = wake + period;
+		scheduler.running->state = OS_SUSPENDED;
+		os_delay_insert(scheduler.running, -late);
+		os_system_switch();
+		if(missed != NULL) {
+			*missed = 0;
+		}
+		return OS_SUCCESS;
+	}
+	hal_systick_t skipped = late / period;
+	*next_wake = wake + (skipped + 1) * period;
+	sei();
+	if(missed != NULL) {
+		*missed = skipped;
+	}
+	return skipped ? OS_TIMEOUT : OS_SUCCESS;
+}
+
+//ticks until the first delayed thread or timer, interrupts must be disabled
+hal_systick_t os_next_deadline(void) {
+	hal_systick_t ticks = HAL_SYSTICK_FOREVER;
+	if(scheduler.delayed != NULL && scheduler.delayed->suspended_timer < ticks) {
+		ticks = scheduler.delayed->suspended_timer;
+	}
+#if OS_TIMERS
+	if(scheduler.timers != NULL && scheduler.timers->remaining < ticks) {
+		ticks = scheduler.timers->remaining;
+	}
+#endif
+	return ticks;
+}
+
+//end the sleep and the stretch, idempotent, interrupts must be disabled
+void os_sleep_exit(void) {
+#if OS_TICKLESS_IDLE
+	os_tickless_exit(0);
+#endif
+	os_sleep_account();
+}
+
+//account the time spent sleeping, the stretch is kept
+//idempotent, interrupts must be disabled
+void os_sleep_account(void) {
+	hal_systick_t ticks = hal_sleep_exitI();
+	if(ticks) {
+		os_delay_advance(ticks);
+	}
+}
+
+#if OS_TICKLESS_IDLE
+
+//stretch the systick up to the next deadline, interrupts must be disabled
+void os_tickless_enter(hal_systick_t ticks) {
+	if(ticks > HAL_SYSTICK_MAX_STRETCH) {
+		ticks = HAL_SYSTICK_MAX_STRETCH;
+	}
+	if(ticks > 1) {
+		hal_systick_stretchI(ticks);
+	}
+}
+
+//back to periodic ticks, the delta list is advanced by the time slept
+//returns 1 if a thread was woken up
+uint8_t os_tickless_exit(uint8_t expired) {
+	if(!hal_systick_stretchedI()) {
+		return 0;
+	}
+	return os_delay_advance(hal_systick_unstretchI(expired));
+}
+
+#endif
+
 ISR(TIMER0_COMPA_vect, ISR_NAKED) {
 	port_context_save(&(scheduler.running->context));
 	hal_sleep_disable();
-	hal_systick_inc();
+	os_trace(OS_TRACE_ISR_ENTER, TIMER0_COMPA_vect_num);
 	os_delay_compute();
+	os_trace(OS_TRACE_ISR_EXIT, TIMER0_COMPA_vect_num);
 
-	if(!(scheduler.running->existing)) {
-		scheduler.running->existing = 1;
-		port_context_create(&scheduler.running->context);
-	} else {
-		port_context_restore(&scheduler.running->context);
+	os_context_switch();
+}
+
+//driver interrupts of the hal, the linux port raises its own handlers
+#ifdef TWI_vect
+OS_ISR(USART_TX_vect, hal_uart_tx_isr)
+OS_ISR(USART_RX_vect, hal_uart_rx_isr)
+OS_ISR(TWI_vect, hal_i2c_isr)
+OS_ISR(SPI_STC_vect, hal_spi_isr)
+#endif
+
+
+
+/* os_timer */
+
+#if OS_TIMERS
+
+/**
+ *  Insert timer in the delta list of armed timers
+ *  same layout as the delta list of suspended threads
+ **/
+void os_timer_insert(os_timer_t * timer, hal_systick_t delay) {
+	os_timer_t ** node;
+	if(delay == 0) {
+		delay = 1; //expire at the next tick at the earliest
+	}
+	for( node = &(scheduler.timers); (*node) != NULL; node = &((*node)->next)) {
+		if(delay < (*node)->remaining) {
+			(*node)->remaining -= delay;
+			break;
+		}
+		delay -= (*node)->remaining;
+	}
+	timer->remaining = delay;
+	timer->next = (*node);
+	(*node) = timer;
+	timer->armed = 1;
+}
+
+//remove timer from the delta list, its remaining delay goes to the next node
+void os_timer_remove(os_timer_t * timer) {
+	os_timer_t ** node;
+	for( node = &(scheduler.timers); (*node) != NULL; node = &((*node)->next)) {
+		if((*node) == timer) {
+			(*node) = timer->next;
+			if(timer->next != NULL) {
+				timer->next->remaining += timer->remaining;
+			}
+			break;
+		}
+	}
+	timer->armed = 0;
+}
+
+/**
+ *  Expire the due timers, called from the systick with interrupts disabled
+ *  periodic timers are rearmed relative to their expiry so they do not drift
+ *  a timer still pending when it expires again misses that period
+ *  returns 1 if the service thread was woken up
+ **/
+uint8_t os_timer_advance(hal_systick_t ticks) {
+	os_timer_t * node = scheduler.timers;
+	if(node == NULL || node->remaining > ticks) {
+		if(node != NULL) {
+			node->remaining -= ticks;
+		}
+		return 0;
 	}
-	port_context_return();
+	do {
+		ticks -= node->remaining;
+		scheduler.timers = node->next;
+		node->armed = 0;
+		if(!node->pending) {
+			node->pending = 1;
+			node->pending_next = NULL;
+			(*scheduler.timer_pending_tail) = node;
+			scheduler.timer_pending_tail = &(node->pending_next);
+		}
+		if(node->period) {
+			os_timer_insert(node, node->period);
+		}
+		node = scheduler.timers;
+	} while(node != NULL && node->remaining <= ticks);
+	if(node != NULL) {
+		node->remaining -= ticks;
+	}
+	return os_wait_wake_one(&(scheduler.timer_waiting)) != NULL;
 }
 
+//run the callbacks of the expired timers, one at a time with interrupts enabled
+void os_timer_service(void) {
+	for(;;) {
+		cli();
+		os_timer_t * timer = scheduler.timer_pending;
+		if(timer == NULL) {
+			os_wait_block(&(scheduler.timer_waiting));
+			continue;
+		}
+		scheduler.timer_pending = timer->pending_next;
+		if(scheduler.timer_pending == NULL) {
+			scheduler.timer_pending_tail = &(scheduler.timer_pending);
+		}
+		timer->pending = 0;
+		void (*callback)(void * arg) = timer->callback;
+		void * arg = timer->arg;
+		sei();
+		callback(arg);
+	}
+}
+
+void os_timer_create(os_timer_t * timer, void (*callback)(void * arg), void * arg) {
+	timer->next = NULL;
+	timer->pending_next = NULL;
+	timer->remaining = 0;
+	timer->period = 0;
+	timer->callback = callback;
+	timer->arg = arg;
+	timer->armed = 0;
+	timer->pending = 0;
+}
+
+//(re)arm the timer to expire after delay ticks, then every period ticks
+//a period of 0 makes a one-shot timer
+void os_timer_start(os_timer_t * timer, hal_systick_t delay, hal_systick_t period) {
+	cli();
+	if(timer->armed) {
+		os_timer_remove(timer);
+	}
+	timer->period = period;
+	os_timer_insert(timer, delay);
+	sei();
+}
+
+//disarm the timer, an expiry whose callback has not run yet is dropped
+void os_timer_stop(os_timer_t * timer) {
+	cli();
+	if(timer->armed) {
+		os_timer_remove(timer);
+	}
+	if(timer->pending) {
+		os_timer_t ** node;
+		for( node = &(scheduler.timer_pending); (*node) != timer; node = &((*node)->pending_next)) {
+		}
+		(*node) = timer->pending_next;
+		if(scheduler.timer_pending_tail == &(timer->pending_next)) {
+			scheduler.timer_pending_tail = node;
+		}
+		timer->pending = 0;
+	}
+	sei();
+}
+
+#endif
+
 
 
 /* os_event */
 
 
 
+/**
+ *  Insert thread in a wait list sorted by decreasing priority
+ *  threads of equal priority are kept in arrival order
+ **/
+void os_wait_insert(os_thread_t ** list, os_thread_t * thd) {
+	os_thread_t ** node;
+	for( node = list; (*node) != NULL; node = &((*node)->queue_next)) {
+		if((*node)->priority < thd->priority) {
+			break;
+		}
+	}
+	thd->queue_next = (*node);
+	(*node) = thd;
+	thd->wait_list = list;
+}
+
+//remove thread from a wait list
+void os_wait_remove(os_thread_t ** list, os_thread_t * thd) {
+	os_thread_t ** node;
+	for( node = list; (*node) != NULL; node = &((*node)->queue_next)) {
+		if((*node) == thd) {
+			(*node) = thd->queue_next;
+			break;
+		}
+	}
+	thd->wait_list = NULL;
+}
+
+//make ready a thread taken out of a wait list, cancelling its timeout
+void os_wait_wake(os_thread_t * thd) {
+	if(thd->timed) {
+		os_delay_remove(thd);
+		thd->timed = 0;
+	}
+	thd->wait_list = NULL;
+	thd->state = OS_READY;
+	os_scheduler_ready_push(&scheduler, thd);
+}
+
+//move the highest priority waiting thread to the ready lists
+os_thread_t * os_wait_wake_one(os_thread_t ** list) {
+	os_thread_t * thd = (*list);
+	if(thd != NULL) {
+		(*list) = thd->queue_next;
+		os_wait_wake(thd);
+	}
+	return thd;
+}
+
+//block the running thread in a wait list
+//called with interrupts disabled, returns with interrupts enabled
+void os_wait_block(os_thread_t ** list) {
+	scheduler.running->state = OS_WAITING;
+	os_wait_insert(list, scheduler.running);
+	os_system_switch();
+}
+
+//move all the waiting threads to the ready lists
+void os_event_wake_all(os_event_t * event) {
+	os_thread_t * node = event->waiting;
+	event->waiting = NULL;
+	while(node != NULL) {
+		os_thread_t * next = node->queue_next;
+		os_wait_wake(node);
+		node = next;
+	}
+}
+
 void os_event_create(os_event_t * event, os_event_state_t state) {
 	event->state = state;
 	event->owner = NULL;
+	event->waiting = NULL;
 }
 
 // puts the thread into waiting for event state
 void os_event_wait(os_event_t * event) {
-	port_context_save(&(scheduler.running->context));
+	port_context_save_light(&(scheduler.running->context));
 
 	scheduler.running->state = OS_WAITING;
-	scheduler.running->waiting_event = event;
+	os_wait_insert(&(event->waiting), scheduler.running);
 
 	os_system_reschedule();
 
-	if(!(scheduler.running->existing)) {
-		scheduler.running->existing = 1;
-		port_context_create(&scheduler.running->context);
-	} else {
-		port_context_restore(&scheduler.running->context);
-	}
-	port_context_return();
+	os_context_switch();
+}
+
+// puts the thread into waiting for event state for at most timeout ticks
+// returns OS_TIMEOUT if the event was not signaled in time
+os_error_t os_event_wait_timeout(os_event_t * event, hal_systick_t timeout) {
+	cli();
+	os_thread_t * self = scheduler.running;
+	self->wait_status = OS_SUCCESS;
+	self->timed = 1;
+	os_delay_insert(self, timeout);
+	os_wait_block(&(event->waiting));
+	return self->wait_status;
 }
 
 // puts all the waiting threads in ready state
+// only the threads in the event wait list are visited
 void os_event_signal(os_event_t * event) {
-	port_context_save(&(scheduler.running->context));
+	port_context_save_light(&(scheduler.running->context));
 
-	scheduler.running->state = OS_READY;
-	os_thread_t * node;
-	for( node = scheduler.head; node != NULL; node = node->next) {
-		if(node->state == OS_WAITING && node->waiting_event == event) {
-			node->state = OS_READY;
-		}
+#if OS_TRACE
+	os_trace(OS_TRACE_SIGNAL, event->waiting != NULL ? event->waiting->id : OS_TRACE_NONE);
+#endif
+	os_event_wake_all(event);
+
+	if(os_scheduler_preempt(&scheduler)) {
+		scheduler.running->state = OS_READY;
+		os_system_reschedule();
 	}
 
-	os_system_reschedule();
+	os_context_switch();
+}
 
-	if(!(scheduler.running->existing)) {
-		scheduler.running->existing = 1;
-		port_context_create(&scheduler.running->context);
-	} else {
-		port_context_restore(&scheduler.running->context);
-	}
-	port_context_return();
+// os_event_signal for interrupt handlers, the threads are only made ready
+// the switch is done by os_isr_exit at the end of the handler
+void os_event_signal_fromISR(os_event_t * event) {
+#if OS_TRACE
+	os_trace(OS_TRACE_SIGNAL, event->waiting != NULL ? event->waiting->id : OS_TRACE_NONE);
+#endif
+	os_event_wake_all(event);
+	os_isr_pend();
 }
 
 // if the event is free, set it to taken
@@ -422,4 +1520,337 @@ void os_event_release(os_event_t * event) {
 
 
 
+/* os_mutex */
+
+void os_mutex_create(os_mutex_t * mutex) {
+	mutex->owner = NULL;
+	mutex->waiting = NULL;
+	mutex->count = 0;
+}
+
+#if OS_MUTEX_INHERIT
+
+//raise the owner of the mutex, and the owners it waits for, to prio
+void os_mutex_inherit(os_mutex_t * mutex, os_priority_t prio) {
+	while(mutex != NULL && mutex->owner->priority < prio) {
+		os_thread_t * owner = mutex->owner;
+		os_scheduler_reprioritize(&scheduler, owner, prio);
+		mutex = owner->waiting_mutex;
+	}
+}
+
+//highest priority of the threads waiting for a mutex of owner, 0 if none
+os_priority_t os_mutex_inherited(os_thread_t * owner) {
+	os_priority_t prio = 0;
+	for(os_thread_t * node = scheduler.head; node != NULL; node = node->next) {
+		if(node->waiting_mutex != NULL && node->waiting_mutex->owner == owner &&
+				node->priority > prio) {
+			prio = node->priority;
+		}
+	}
+	return prio;
+}
+
+//back to the base priority of owner or what its waiters still lend,
+//then the same for the owners it waits for
+void os_mutex_recompute(os_thread_t * owner) {
+	while(owner != NULL) {
+		os_priority_t prio = os_mutex_inherited(owner);
+		if(prio < owner->base_priority) {
+			prio = owner->base_priority;
+		}
+		if(prio == owner->priority) {
+			return;
+		}
+		os_scheduler_reprioritize(&scheduler, owner, prio);
+		owner = owner->waiting_mutex != NULL ? owner->waiting_mutex->owner : NULL;
+	}
+}
+
+#endif
+
+// take the mutex, waiting for it if owned by another thread
+// the owner (and the owners it waits for) inherit our priority
+void os_mutex_lock(os_mutex_t * mutex) {
+	cli();
+	os_thread_t * self = scheduler.running;
+
+	if(mutex->owner == NULL) {
+		mutex->owner = self;
+		mutex->count = 1;
+		self->mutex_held++;
+		sei();
+		return;
+	}
+	if(mutex->owner == self) {
+		mutex->count++;
+		sei();
+		return;
+	}
+
+#if OS_MUTEX_INHERIT
+	os_mutex_inherit(mutex, self->priority);
+#endif
+
+	self->state = OS_WAITING;
+	self->waiting_mutex = mutex;
+	os_wait_insert(&(mutex->waiting), self);
+
+	//ownership is handed over by os_mutex_unlock
+	os_system_switch();
+}
+
+// release the mutex if owned, the highest priority waiter becomes the owner
+// the priority inherited through this mutex is dropped
+void os_mutex_unlock(os_mutex_t * mutex) {
+	cli();
+	os_thread_t * self = scheduler.running;
+
+	if(mutex->owner != self) {
+		sei();
+		return;
+	}
+	if(--(mutex->count)) {
+		sei();
+		return;
+	}
+
+	self->mutex_held--;
+
+	os_thread_t * next = mutex->waiting;
+	if(next == NULL) {
+		mutex->owner = NULL;
+	} else {
+		mutex->waiting = next->queue_next;
+		next->waiting_mutex = NULL;
+		mutex->owner = next;
+		mutex->count = 1;
+		next->mutex_held++;
+#if OS_MUTEX_INHERIT
+		if(mutex->waiting != NULL && mutex->waiting->priority > next->priority) {
+			next->priority = mutex->waiting->priority;
+		}
+#endif
+		os_wait_wake(next);
+	}
+
+#if OS_MUTEX_INHERIT
+	//the waiters of the other mutexes held still lend their priority
+	os_mutex_recompute(self);
+#else
+	if(self->mutex_held == 0) {
+		self->priority = self->base_priority;
+	}
+#endif
+
+	if(os_scheduler_preempt(&scheduler)) {
+		self->state = OS_READY;
+		os_system_switch();
+	} else {
+		sei();
+	}
+}
+
+
+
+/* os_sem */
+
+void os_sem_create(os_sem_t * sem, uint16_t count) {
+	sem->count = count;
+	sem->waiting = NULL;
+}
+
+// take one unit, waiting if none is available
+void os_sem_wait(os_sem_t * sem) {
+	cli();
+	if(sem->count) {
+		sem->count--;
+		sei();
+		return;
+	}
+	//the unit is handed over by os_sem_post
+	os_wait_block(&(sem->waiting));
+}
+
+// give one unit, directly to the highest priority waiter if any
+void os_sem_post(os_sem_t * sem) {
+	cli();
+	if(os_wait_wake_one(&(sem->waiting)) == NULL) {
+		sem->count++;
+	} else if(os_scheduler_preempt(&scheduler)) {
+		scheduler.running->state = OS_READY;
+		os_system_switch();
+		return;
+	}
+	sei();
+}
+
+// same as os_sem_post, for interrupt context (no context switch)
+void os_sem_post_fromISR(os_sem_t * sem) {
+	if(os_wait_wake_one(&(sem->waiting)) == NULL) {
+		sem->count++;
+	} else {
+		os_isr_pend();
+	}
+}
+
+
+
+/* os_queue */
+
+void os_copy(uint8_t * dst, const uint8_t * src, uint8_t size) {
+	while(size--) {
+		*dst++ = *src++;
+	}
+}
+
+void os_queue_create(os_queue_t * queue, void * buffer, uint8_t item_size, uint8_t length) {
+	queue->buffer = buffer;
+	queue->item_size = item_size;
+	queue->length = length;
+	queue->count = 0;
+	queue->head = 0;
+	queue->senders = NULL;
+	queue->receivers = NULL;
+}
+
+//copy an item at the back of the queue, interrupts must be disabled
+//returns OS_BUSY if the queue is full
+os_error_t os_queue_putI(os_queue_t * queue, const void * item) {
+	if(queue->count == queue->length) {
+		return OS_BUSY;
+	}
+	uint8_t index = queue->head + queue->count;
+	if(index >= queue->length) {
+		index -= queue->length;
+	}
+	os_copy(&(queue->buffer[index * queue->item_size]), item, queue->item_size);
+	queue->count++;
+	os_wait_wake_one(&(queue->receivers));
+	return OS_SUCCESS;
+}
+
+//copy the item at the front of the queue, interrupts must be disabled
+//returns OS_BUSY if the queue is empty
+os_error_t os_queue_getI(os_queue_t * queue, void * item) {
+	if(queue->count == 0) {
+		return OS_BUSY;
+	}
+	os_copy(item, &(queue->buffer[queue->head * queue->item_size]), queue->item_size);
+	queue->head++;
+	if(queue->head >= queue->length) {
+		queue->head = 0;
+	}
+	queue->count--;
+	os_wait_wake_one(&(queue->senders));
+	return OS_SUCCESS;
+}
+
+// send an item, waiting while the queue is full
+void os_queue_send(os_queue_t * queue, const void * item) {
+	cli();
+	while(os_queue_putI(queue, item) != OS_SUCCESS) {
+		os_wait_block(&(queue->senders));
+		cli();
+	}
+	if(os_scheduler_preempt(&scheduler)) {
+		scheduler.running->state = OS_READY;
+		os_system_switch();
+		return;
+	}
+	sei();
+}
+
+// receive an item, waiting while the queue is empty
+void os_queue_receive(os_queue_t * queue, void * item) {
+	cli();
+	while(os_queue_getI(queue, item) != OS_SUCCESS) {
+		os_wait_block(&(queue->receivers));
+		cli();
+	}
+	if(os_scheduler_preempt(&scheduler)) {
+		scheduler.running->state = OS_READY;
+		os_system_switch();
+		return;
+	}
+	sei();
+}
+
+// send an item from interrupt context, never waits
+// returns OS_BUSY if the queue is full
+os_error_t os_queue_send_fromISR(os_queue_t * queue, const void * item) {
+	os_error_t error = os_queue_putI(queue, item);
+	os_isr_pend();
+	return error;
+}
+
+
+
+/* os_pool */
+
+void os_pool_create(os_pool_t * pool, void * buffer, uint8_t block_size, uint8_t count) {
+	if(block_size < sizeof(uint8_t *)) {
+		os_system_panic("pool block");
+	}
+	pool->buffer = buffer;
+	pool->block_size = block_size;
+	pool->count = count;
+	pool->used = 0;
+	pool->peak = 0;
+	pool->failed = 0;
+	//chain the blocks in address order
+	pool->free = NULL;
+	uint8_t * block = pool->buffer + (uint16_t) block_size * count;
+	while(block != pool->buffer) {
+		block -= block_size;
+		*((uint8_t **) block) = pool->free;
+		pool->free = block;
+	}
+}
+
+// returns a block or NULL if the pool is empty, usable from interrupts
+void * os_pool_alloc(os_pool_t * pool) {
+	uint8_t sreg;
+	port_irq_save(sreg);
+	uint8_t * block = pool->free;
+	if(block == NULL) {
+		pool->failed++;
+	} else {
+		pool->free = *((uint8_t **) block);
+		if(++(pool->used) > pool->peak) {
+			pool->peak = pool->used;
+		}
+	}
+	port_irq_restore(sreg);
+	return block;
+}
+
+// give a block back to its pool, usable from interrupts
+// returns OS_ERROR for a pointer that is not a block of the pool or
+// a block already free (found by walking the free list, interrupts
+// stay disabled for at most count-used nodes)
+os_error_t os_pool_free(os_pool_t * pool, void * block) {
+	uint16_t offset = (uint8_t *) block - pool->buffer;
+	if((uint8_t *) block < pool->buffer ||
+			offset >= (uint16_t) pool->block_size * pool->count ||
+			offset % pool->block_size != 0) {
+		return OS_ERROR;
+	}
+	uint8_t sreg;
+	port_irq_save(sreg);
+	for(uint8_t * node = pool->free; node != NULL; node = *((uint8_t **) node)) {
+		if(node == block) {
+			port_irq_restore(sreg);
+			return OS_ERROR;
+		}
+	}
+	*((uint8_t **) block) = pool->free;
+	pool->free = block;
+	pool->used--;
+	port_irq_restore(sreg);
+	return OS_SUCCESS;
+}
+
+
+
 /* END */
@@ -0,0 +1,129 @@
+/*  Title		: os_trace
+ *  Filename		: os_trace.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: scheduler trace ring buffer
+ *
+ *	dump format (little endian), preceded and followed by any uart text:
+ *	"STRC", version, counts per tick, count length in ns (u16),
+ *	thread count, per thread: id, priority, name[OS_THREAD_NAME_LEN],
+ *	lost records (u16), record count (u16),
+ *	records (type, arg, count, tick u16)
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <os.h>
+#include <os_trace.h>
+#include <hal.h>
+
+#if OS_TRACE
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#if OS_TRACE_LEN > 255
+#error "OS_TRACE_LEN must fit in 8 bits"
+#endif
+
+#define TRACE_COUNT_NS	((uint16_t) (HAL_SYSTICK_PRESCALER * 1000000000ULL / F_CPU))
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static os_trace_record_t trace_buffer[OS_TRACE_LEN];
+
+static uint8_t trace_head;	//next record written
+static uint8_t trace_count;	//valid records
+static uint16_t trace_lost;	//records overwritten since the last dump
+static uint8_t trace_frozen;	//dump in progress
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+//called with interrupts disabled
+void os_trace_recordI(uint8_t type, uint8_t arg) {
+	if(trace_frozen) {
+		return;
+	}
+	os_trace_record_t * rec = &(trace_buffer[trace_head]);
+	rec->type = type;
+	rec->arg = arg;
+	uint32_t stamp = hal_systick_stampI();
+	rec->count = (uint8_t) stamp;
+	rec->tick = (uint16_t) (stamp >> 8);
+	if(++trace_head == OS_TRACE_LEN) {
+		trace_head = 0;
+	}
+	if(trace_count < OS_TRACE_LEN) {
+		trace_count++;
+	} else {
+		trace_lost++;
+	}
+}
+
+//send the buffer in binary form and empty it
+//recording is paused while sending
+void os_trace_dump(void) {
+	uint8_t header[5] = {
+		OS_TRACE_VERSION,
+		HAL_SYSTICK_COUNTS,
+		(uint8_t) TRACE_COUNT_NS,
+		(uint8_t) (TRACE_COUNT_NS >> 8),
+		0
+	};
+
+	cli();
+	trace_frozen = 1;
+	sei();
+
+	//an interrupt driven print would drop the dump
+	hal_uart_flush();
+
+	for(os_thread_t * node = os_thread_get_list(); node != NULL; node = node->next) {
+		header[4]++;
+	}
+	hal_uart_send((uint8_t *) "STRC", 4);
+	hal_uart_send(header, 5);
+	for(os_thread_t * node = os_thread_get_list(); node != NULL; node = node->next) {
+		hal_uart_send(&(node->id), 1);
+		hal_uart_send(&(node->base_priority), 1);
+		hal_uart_send(node->name, OS_THREAD_NAME_LEN);
+	}
+
+	uint16_t count = trace_count;
+	hal_uart_send((uint8_t *) &trace_lost, 2);
+	hal_uart_send((uint8_t *) &count, 2);
+
+	//oldest record first, hal_uart_send does not accept empty buffers
+	if(trace_count < OS_TRACE_LEN) {
+		if(trace_count) {
+			hal_uart_send((uint8_t *) trace_buffer, trace_count * sizeof(os_trace_record_t));
+		}
+	} else {
+		hal_uart_send((uint8_t *) &(trace_buffer[trace_head]),
+				(OS_TRACE_LEN - trace_head) * sizeof(os_trace_record_t));
+		if(trace_head) {
+			hal_uart_send((uint8_t *) trace_buffer, trace_head * sizeof(os_trace_record_t));
+		}
+	}
+
+	cli();
+	trace_head = 0;
+	trace_count = 0;
+	trace_lost = 0;
+	trace_frozen = 0;
+	sei();
+}
+
+#endif
+
+/* END */
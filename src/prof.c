@@ -0,0 +1,147 @@
+/*  Title		: prof
+ *  Filename		: prof.c
+ *	Author		: iacopo sprenger
+ *	Date		: 17.10.2026
+ *	Version		: 0.1
+ *	Description	: hot path profiling with cycle histograms
+ *
+ *	dump format, one line per site that ran:
+ *	prof <name> n <runs> min <cycles> mean <cycles> max <cycles> hist <buckets>
+ */
+
+/**********************
+ *	INCLUDES
+ **********************/
+
+#include <prof.h>
+#include <os.h>
+#include <hal.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#if PROF_ENABLE
+
+/**********************
+ *	CONSTANTS
+ **********************/
+
+#if HAL_SLEEP_TIMER2_ASYNC
+#error "PROF_ENABLE needs timer2, it is clocked by the crystal"
+#endif
+
+#define PROF_CS		0b010
+#define PROF_NAME_LEN	8
+
+
+/**********************
+ *	VARIABLES
+ **********************/
+
+static const char prof_names[PROF_SITES][PROF_NAME_LEN] PROGMEM = {
+	"led pwm ",
+	"twi     ",
+	"uart dre",
+	"systick ",
+	"resched "
+};
+
+static prof_stats_t prof_stats[PROF_SITES];
+
+//high byte of the time, incremented on timer2 overflow
+static volatile uint8_t prof_high;
+
+
+/**********************
+ *	DECLARATIONS
+ **********************/
+
+void prof_init(void) {
+	TCCR2B = 0;
+	TCCR2A = 0;	//normal mode, free running
+	TCNT2 = 0;
+	TIFR2 = 1<<TOV2;
+	TIMSK2 = 1<<TOIE2;
+	TCCR2B = PROF_CS;
+}
+
+//time in timer counts, wraps every 65536 counts
+uint16_t prof_nowI(void) {
+	uint8_t high = prof_high;
+	uint8_t low = TCNT2;
+	if((TIFR2 & (1<<TOV2)) && low < 0x80) {
+		//overflow not serviced yet (called from an interrupt)
+		high++;
+	}
+	return ((uint16_t) high << 8) | low;
+}
+
+void prof_recordI(prof_site_t site, uint16_t start) {
+	uint16_t time = prof_nowI() - start;
+	prof_stats_t * stats = &(prof_stats[site]);
+	if(stats->count == 0 || time < stats->min) {
+		stats->min = time;
+	}
+	if(time > stats->max) {
+		stats->max = time;
+	}
+	//the mean stops at 65535 runs, min, max and histogram go on
+	if(stats->count < 0xFFFF) {
+		stats->count++;
+		stats->sum += time;
+	}
+	uint8_t bucket = 0;
+	while(time && bucket < PROF_BUCKETS-1) {
+		time >>= 1;
+		bucket++;
+	}
+	if(stats->hist[bucket] < 0xFFFF) {
+		stats->hist[bucket]++;
+	}
+}
+
+//print the statistics in cycles and clear them
+//everything goes through hal_uart_send, after any interrupt driven print
+void prof_dump(void) {
+	prof_stats_t stats;
+	uint8_t name[PROF_NAME_LEN];
+	hal_uart_flush();
+	for(uint8_t site = 0; site < PROF_SITES; site++) {
+		cli();
+		stats = prof_stats[site];
+		prof_stats[site] = (prof_stats_t) {0};
+		sei();
+		if(stats.count == 0) {
+			continue;
+		}
+		hal_print("prof ");
+		memcpy_P(name, prof_names[site], PROF_NAME_LEN);
+		hal_uart_send(name, PROF_NAME_LEN);
+		hal_print(" n ");
+		os_print_u16(stats.count);
+		hal_print(" min ");
+		os_print_u32((uint32_t) stats.min * PROF_CYCLES_PER_COUNT);
+		hal_print(" mean ");
+		os_print_u32(stats.sum / stats.count * PROF_CYCLES_PER_COUNT);
+		hal_print(" max ");
+		os_print_u32((uint32_t) stats.max * PROF_CYCLES_PER_COUNT);
+		hal_print(" hist");
+		for(uint8_t i = 0; i < PROF_BUCKETS; i++) {
+			hal_print(" ");
+			os_print_u16(stats.hist[i]);
+		}
+		hal_print("\n\r");
+	}
+}
+
+
+/**********************
+ *	INTERRUPTS
+ **********************/
+
+ISR(TIMER2_OVF_vect) {
+	prof_high++;
+}
+
+#endif
+
+/* END */
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+#  Title       : bench_compare
+#  Filename    : bench_compare.py
+#  Author      : iacopo sprenger
+#  Date        : 17.10.2026
+#  Version     : 0.1
+#  Description : compare two `make bench` result files
+#
+#  usage: bench_compare.py old.csv new.csv [-t percent]
+#  Rows are matched on (name, param). Every avg that changed is printed,
+#  the exit status is 1 if one grew by more than the tolerance. simulavr
+#  is cycle exact, so any change comes from the code.
+
+import argparse
+import csv
+import sys
+
+
+def load(path):
+    rows = {}
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            rows[(row["name"], int(row["param"]))] = row
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compare two make bench result files")
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("-t", "--tolerance", type=float, default=5.0,
+                        help="avg increase in percent reported as a regression")
+    args = parser.parse_args()
+
+    old = load(args.old)
+    new = load(args.new)
+
+    regressions = 0
+    for key in sorted(new):
+        name, param = key
+        if key not in old:
+            print(f"{name},{param}: new, avg {new[key]['avg']}")
+            continue
+        before = int(old[key]["avg"])
+        after = int(new[key]["avg"])
+        if before == after:
+            continue
+        change = 100.0 * (after - before) / before if before else float("inf")
+        tag = ""
+        if change > args.tolerance:
+            tag = " REGRESSION"
+            regressions += 1
+        print(f"{name},{param}: avg {before} -> {after} ({change:+.1f}%){tag}")
+    for key in sorted(set(old) - set(new)):
+        print(f"{key[0]},{key[1]}: missing")
+
+    if regressions:
+        print(f"{regressions} regression(s) above {args.tolerance}%")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
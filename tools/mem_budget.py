@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#  Title       : mem_budget
+#  Filename    : mem_budget.py
+#  Author      : iacopo sprenger
+#  Date        : 17.10.2026
+#  Version     : 0.1
+#  Description : ram and flash usage per source module against budgets
+#
+#  usage: mem_budget.py firmware.elf build/*.o [-b mem_budget.cfg]
+#                       [--size avr-size] [--nm avr-nm]
+#  The sections of each object are attributed to its module, on the avr
+#  .rodata (string literals, const tables without PROGMEM) is copied to
+#  ram like .data. What the elf holds beyond the objects (libc, libgcc,
+#  vectors) is the "other" module. The reservations of the budget file
+#  are added to the ram total. The exit status is 1 if a budget is
+#  exceeded.
+
+import argparse
+import os
+import subprocess
+import sys
+
+#section prefix: (flash, ram)
+SECTIONS = {
+    ".text": (True, False),
+    ".progmem": (True, False),
+    ".data": (True, True),
+    ".rodata": (True, True),
+    ".bss": (False, True),
+    ".noinit": (False, True),
+}
+
+#largest ram symbols listed per module
+TOP_SYMBOLS = 3
+
+
+def section_sizes(size_tool, path):
+    out = subprocess.run([size_tool, "-A", path], check=True,
+                         capture_output=True, text=True).stdout
+    sizes = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) < 2 or not fields[0].startswith("."):
+            continue
+        for prefix in SECTIONS:
+            if fields[0] == prefix or fields[0].startswith(prefix + "."):
+                sizes[prefix] = sizes.get(prefix, 0) + int(fields[1])
+    return sizes
+
+
+def ram_symbols(nm_tool, path):
+    out = subprocess.run([nm_tool, "--print-size", "--size-sort", "-r", path],
+                         check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "bBdDrR":
+            symbols.append((fields[3], int(fields[1], 16)))
+    return symbols[:TOP_SYMBOLS]
+
+
+def usage(sizes):
+    flash = sum(v for k, v in sizes.items() if SECTIONS[k][0])
+    ram = sum(v for k, v in sizes.items() if SECTIONS[k][1])
+    return flash, ram
+
+
+def load_budget(path):
+    budgets = {}
+    reserves = {}
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            fields = line.split("#")[0].split()
+            if not fields:
+                continue
+            if fields[0] == "reserve" and len(fields) == 3:
+                reserves[fields[1]] = int(fields[2], 0)
+            elif len(fields) == 3:
+                budgets[fields[0]] = (int(fields[1], 0), int(fields[2], 0))
+            else:
+                sys.exit(f"{path}:{number}: expected 'module flash ram' or 'reserve name bytes'")
+    return budgets, reserves
+
+
+def check(name, flash, ram, budgets):
+    if name not in budgets:
+        return "", 0
+    flash_max, ram_max = budgets[name]
+    over = []
+    if flash > flash_max:
+        over.append(f"flash +{flash - flash_max}")
+    if ram > ram_max:
+        over.append(f"ram +{ram - ram_max}")
+    if over:
+        return "OVER " + ", ".join(over), 1
+    return f"ok ({flash_max}/{ram_max})", 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="ram and flash usage per module")
+    parser.add_argument("elf")
+    parser.add_argument("objects", nargs="+")
+    parser.add_argument("-b", "--budget", default=os.path.join(os.path.dirname(__file__), "mem_budget.cfg"))
+    parser.add_argument("--size", default="avr-size")
+    parser.add_argument("--nm", default="avr-nm")
+    args = parser.parse_args()
+
+    budgets, reserves = load_budget(args.budget)
+
+    rows = []
+    module_flash = 0
+    module_ram = 0
+    for path in sorted(args.objects):
+        name = os.path.splitext(os.path.basename(path))[0] + ".c"
+        sizes = section_sizes(args.size, path)
+        flash, ram = usage(sizes)
+        module_flash += flash
+        module_ram += ram
+        rows.append((name, sizes, flash, ram, ram_symbols(args.nm, path)))
+
+    elf_flash, elf_ram = usage(section_sizes(args.size, args.elf))
+    other = {".text": max(elf_flash - module_flash, 0), ".bss": max(elf_ram - module_ram, 0)}
+    rows.append(("other", other, other[".text"], other[".bss"], []))
+
+    print(f"{'module':<12}{'text':>7}{'data':>7}{'rodata':>7}{'bss':>7}{'flash':>8}{'ram':>7}  budget (flash/ram)")
+    failed = 0
+    for name, sizes, flash, ram, symbols in rows:
+        status, over = check(name, flash, ram, budgets)
+        failed += over
+        print(f"{name:<12}{sizes.get('.text', 0) + sizes.get('.progmem', 0):>7}"
+              f"{sizes.get('.data', 0):>7}{sizes.get('.rodata', 0):>7}"
+              f"{sizes.get('.bss', 0) + sizes.get('.noinit', 0):>7}{flash:>8}{ram:>7}  {status}")
+        for symbol, size in symbols:
+            print(f"{'':<14}{symbol} {size}")
+
+    for name, size in reserves.items():
+        print(f"{'reserve':<12}{'':>36}{size:>7}  {name}")
+    total_ram = elf_ram + sum(reserves.values())
+    status, over = check("total", elf_flash, total_ram, budgets)
+    failed += over
+    print(f"{'total':<12}{'':>28}{elf_flash:>8}{total_ram:>7}  {status}")
+
+    if failed:
+        print(f"{failed} budget(s) exceeded")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#  Title       : os_trace
+#  Filename    : os_trace.py
+#  Author      : iacopo sprenger
+#  Date        : 17.10.2026
+#  Version     : 0.1
+#  Description : decode SanpellegrinOS trace dumps into chrome trace json
+#
+#  usage: os_trace.py capture.bin [-o trace.json]
+#  capture.bin is the raw uart output of the board (e.g. from
+#  `cat /dev/ttyACM0 > capture.bin`), text between the dumps is ignored.
+#  Open the result in chrome://tracing or https://ui.perfetto.dev
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"STRC"
+VERSION = 2
+NAME_LEN = 8
+
+TRACE_SWITCH = 1
+TRACE_SIGNAL = 2
+TRACE_ISR_ENTER = 3
+TRACE_ISR_EXIT = 4
+TRACE_EXPIRE = 5
+
+#atmega328p vector numbers
+VECTORS = {
+    6: "WDT",
+    7: "TIMER2_COMPA",
+    14: "TIMER0_COMPA",
+    17: "SPI_STC",
+    18: "USART_RX",
+    20: "USART_TX",
+    24: "TWI",
+}
+
+ISR_TID = 1000
+
+
+class Dump:
+    def __init__(self):
+        self.counts_per_tick = 0
+        self.count_ns = 0
+        self.threads = {}
+        self.lost = 0
+        self.records = []
+
+
+def parse_dumps(data):
+    dumps = []
+    pos = data.find(MAGIC)
+    while pos >= 0:
+        try:
+            dump, end = parse_dump(data, pos + len(MAGIC))
+            dumps.append(dump)
+        except (struct.error, ValueError) as err:
+            print("skipping dump at %d: %s" % (pos, err), file=sys.stderr)
+            end = pos + len(MAGIC)
+        pos = data.find(MAGIC, end)
+    return dumps
+
+
+def parse_dump(data, pos):
+    dump = Dump()
+    version, dump.counts_per_tick, dump.count_ns, n_threads = struct.unpack_from("<BBHB", data, pos)
+    pos += 5
+    if version != VERSION:
+        raise ValueError("unknown version %d" % version)
+    for _ in range(n_threads):
+        tid, prio = struct.unpack_from("<BB", data, pos)
+        name = data[pos + 2:pos + 2 + NAME_LEN].split(b"\0")[0].decode("ascii", "replace").strip()
+        dump.threads[tid] = (name, prio)
+        pos += 2 + NAME_LEN
+    dump.lost, count = struct.unpack_from("<HH", data, pos)
+    pos += 4
+    for _ in range(count):
+        dump.records.append(struct.unpack_from("<BBBH", data, pos))
+        pos += 5
+    return dump, pos
+
+
+def to_events(dumps):
+    events = []
+    threads = {}
+    tick = 0
+    last_tick16 = None
+    for dump in dumps:
+        threads.update(dump.threads)
+        if dump.lost:
+            print("%d records lost before this dump" % dump.lost, file=sys.stderr)
+        running = None
+        running_since = None
+        for rtype, arg, count, tick16 in dump.records:
+            #unwrap the 16 bit tick, the firmware records every watchdog
+            #wake-up so there is a record at least every 65536 ticks
+            if last_tick16 is not None:
+                tick += (tick16 - last_tick16) & 0xFFFF
+            last_tick16 = tick16
+            ts = (tick * dump.counts_per_tick + count) * dump.count_ns / 1000.0
+
+            if rtype == TRACE_SWITCH:
+                if running is not None:
+                    events.append({"ph": "X", "pid": 0, "tid": running, "ts": running_since,
+                                   "dur": ts - running_since, "name": thread_name(threads, running)})
+                running = arg
+                running_since = ts
+            elif rtype == TRACE_ISR_ENTER:
+                events.append({"ph": "B", "pid": 0, "tid": ISR_TID, "ts": ts,
+                               "name": VECTORS.get(arg, "vector %d" % arg)})
+            elif rtype == TRACE_ISR_EXIT:
+                events.append({"ph": "E", "pid": 0, "tid": ISR_TID, "ts": ts})
+            elif rtype == TRACE_SIGNAL:
+                events.append({"ph": "i", "pid": 0, "tid": running if running is not None else ISR_TID,
+                               "ts": ts, "s": "t", "name": "signal",
+                               "args": {"woken": thread_name(threads, arg)}})
+            elif rtype == TRACE_EXPIRE:
+                events.append({"ph": "i", "pid": 0, "tid": arg, "ts": ts, "s": "t", "name": "delay expired"})
+            else:
+                print("unknown record type %d" % rtype, file=sys.stderr)
+
+    for tid, (name, prio) in threads.items():
+        events.append({"ph": "M", "pid": 0, "tid": tid, "name": "thread_name",
+                       "args": {"name": "%s (%d)" % (name, prio)}})
+        events.append({"ph": "M", "pid": 0, "tid": tid, "name": "thread_sort_index",
+                       "args": {"sort_index": -prio}})
+    events.append({"ph": "M", "pid": 0, "tid": ISR_TID, "name": "thread_name", "args": {"name": "interrupts"}})
+    events.append({"ph": "M", "pid": 0, "tid": ISR_TID, "name": "thread_sort_index", "args": {"sort_index": -100}})
+    return events
+
+
+def thread_name(threads, tid):
+    if tid == 0xFF:
+        return "none"
+    return threads.get(tid, ("thread %d" % tid, 0))[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="decode SanpellegrinOS trace dumps")
+    parser.add_argument("capture", help="raw uart capture")
+    parser.add_argument("-o", "--output", default="trace.json", help="chrome trace json")
+    args = parser.parse_args()
+
+    with open(args.capture, "rb") as f:
+        data = f.read()
+    dumps = parse_dumps(data)
+    if not dumps:
+        print("no trace dump found", file=sys.stderr)
+        return 1
+
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": to_events(dumps), "displayTimeUnit": "ms"}, f)
+    print("%d dumps, %d records -> %s" % (len(dumps), sum(len(d.records) for d in dumps), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())